@@ -0,0 +1,317 @@
+// Headless ThreadPool benchmark: enqueue cost, submit-to-start latency,
+// throughput for empty/small/large jobs, callback round trip and scaling
+// over the number of workers. Run with --help for options.
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+using Clock = chrono::steady_clock;
+
+namespace
+{
+	struct Options
+	{
+		size_t maxWorkers = 0;
+		size_t jobs = 20000;
+		size_t latencySamples = 5000;
+		bool useFibers = false;
+		bool lockStats = false;
+	};
+
+	uint64_t NowNs()
+	{
+		return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	// Busy work the optimiser can't drop
+	void Spin(uint32_t iterations)
+	{
+		volatile uint32_t sink = 0;
+		for (uint32_t i = 0; i < iterations; ++i)
+		{
+			sink = sink + i;
+		}
+	}
+
+	class BenchJob : public IJob
+	{
+	public:
+		uint32_t work = 0;
+		uint64_t submitTime = 0;
+		uint64_t startTime = 0;
+		uint64_t callbackTime = 0;
+
+		virtual void Execute() override
+		{
+			startTime = NowNs();
+			Spin(work);
+		}
+		virtual void Callback() override
+		{
+			callbackTime = NowNs();
+		}
+		virtual const char* GetName() override { return "BenchJob"; }
+	};
+
+	ThreadPoolSettings MakeSettings(const Options& options, size_t workers)
+	{
+		ThreadPoolSettings settings;
+		settings.numberOfThreads = workers;
+		settings.numberOfIOThreads = 0;
+		settings.useFibers = options.useFibers;
+		settings.threadName = "Bench";
+		return settings;
+	}
+
+	double Percentile(vector<double>& samples, double p)
+	{
+		if (samples.empty())
+			return 0.0;
+		size_t index = min(samples.size() - 1, (size_t)(p / 100.0 * (samples.size() - 1) + 0.5));
+		nth_element(samples.begin(), samples.begin() + index, samples.end());
+		return samples[index];
+	}
+
+	void PrintPercentiles(const char* label, vector<double> samples)
+	{
+		double p50 = Percentile(samples, 50.0);
+		double p90 = Percentile(samples, 90.0);
+		double p99 = Percentile(samples, 99.0);
+		double maxValue = samples.empty() ? 0.0 : *max_element(samples.begin(), samples.end());
+		printf("  %-28s p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f us\n", label, p50, p90, p99, maxValue);
+	}
+
+	// Producer side cost only, the counter wait is outside the timed region
+	void BenchEnqueueCost(const Options& options, size_t workers)
+	{
+		printf("\nEnqueue cost (%zu workers, empty jobs)\n", workers);
+		ThreadPool pool(MakeSettings(options, workers));
+		vector<BenchJob> jobs(options.jobs);
+		vector<IJob*> pointers(jobs.size());
+		for (size_t i = 0; i < jobs.size(); ++i)
+		{
+			pointers[i] = &jobs[i];
+		}
+
+		for (size_t batchSize : { (size_t)1, (size_t)64, (size_t)4096 })
+		{
+			JobCounter counter;
+			double singleNs = 0.0;
+			double batchNs = 0.0;
+
+			// The same groups submitted one Enqueue per job, so the columns compare
+			for (size_t first = 0; first < pointers.size(); first += batchSize)
+			{
+				size_t count = min(batchSize, pointers.size() - first);
+				auto groupStart = Clock::now();
+				for (size_t i = first; i < first + count; ++i)
+				{
+					pool.Enqueue(pointers[i], &counter);
+				}
+				singleNs += chrono::duration<double, nano>(Clock::now() - groupStart).count();
+			}
+			pool.WaitForCounter(&counter);
+			pool.ExecuteCallbacks();
+
+			for (size_t first = 0; first < pointers.size(); first += batchSize)
+			{
+				size_t count = min(batchSize, pointers.size() - first);
+				auto batchStart = Clock::now();
+				pool.EnqueueBatch(span<IJob* const>(pointers.data() + first, count), &counter);
+				batchNs += chrono::duration<double, nano>(Clock::now() - batchStart).count();
+			}
+			pool.WaitForCounter(&counter);
+			pool.ExecuteCallbacks();
+
+			printf("  batch %5zu: Enqueue %8.1f ns/job   EnqueueBatch %8.1f ns/job\n",
+				batchSize, singleNs / pointers.size(), batchNs / pointers.size());
+		}
+	}
+
+	// One job in flight at a time, so each sample is a cold submit to a
+	// worker that is spinning or parked, not time spent behind other jobs
+	void BenchLatency(const Options& options, size_t workers)
+	{
+		printf("\nSubmit-to-start latency (%zu workers, %zu samples)\n", workers, options.latencySamples);
+		ThreadPool pool(MakeSettings(options, workers));
+		BenchJob job;
+
+		for (auto gap : { chrono::microseconds(0), chrono::microseconds(200) })
+		{
+			vector<double> samples;
+			samples.reserve(options.latencySamples);
+			for (size_t i = 0; i < options.latencySamples; ++i)
+			{
+				JobCounter counter;
+				job.submitTime = NowNs();
+				pool.Enqueue(&job, &counter);
+				while (!counter.IsZero())
+				{
+					this_thread::yield();
+				}
+				samples.push_back((job.startTime - job.submitTime) / 1000.0);
+				if (gap.count() > 0)
+				{
+					// Long enough for the worker to give up spinning and park
+					this_thread::sleep_for(gap);
+				}
+			}
+			pool.ExecuteCallbacks();
+			PrintPercentiles(gap.count() > 0 ? "idle workers (200us gap)" : "back to back", samples);
+		}
+	}
+
+	double MeasureThroughput(ThreadPool& pool, vector<BenchJob>& jobs, vector<IJob*>& pointers, uint32_t work)
+	{
+		for (auto& job : jobs)
+		{
+			job.work = work;
+		}
+
+		JobCounter counter;
+		auto start = Clock::now();
+		pool.EnqueueBatch(pointers, &counter);
+		pool.WaitForCounter(&counter);
+		double seconds = chrono::duration<double>(Clock::now() - start).count();
+		pool.ExecuteCallbacks();
+		return jobs.size() / seconds;
+	}
+
+	struct JobSize
+	{
+		const char* name;
+		uint32_t work;
+		size_t divisor;	// fewer large jobs keep the run short
+	};
+	const JobSize JobSizes[] = { { "empty", 0, 1 }, { "small", 200, 1 }, { "large", 200000, 50 } };
+
+	void BenchThroughput(const Options& options, size_t workers)
+	{
+		printf("\nThroughput (%zu workers, main thread helps while waiting)\n", workers);
+		ThreadPool pool(MakeSettings(options, workers));
+
+		for (auto& size : JobSizes)
+		{
+			vector<BenchJob> jobs(max((size_t)1, options.jobs / size.divisor));
+			vector<IJob*> pointers;
+			for (auto& job : jobs)
+			{
+				pointers.push_back(&job);
+			}
+			pool.ResetLockStats();
+			double jobsPerSecond = MeasureThroughput(pool, jobs, pointers, size.work);
+			printf("  %-6s %8zu jobs  %12.0f jobs/s  %8.3f us/job\n", size.name, jobs.size(), jobsPerSecond, 1e6 / jobsPerSecond);
+			if (options.lockStats)
+			{
+				LockStats::Print(pool.GetLockStats());
+			}
+		}
+	}
+
+	// Enqueue on the main thread until Callback runs from ExecuteCallbacks,
+	// pumping callbacks the way a frame loop would
+	void BenchCallbackRoundTrip(const Options& options, size_t workers)
+	{
+		printf("\nCallback round trip (%zu workers)\n", workers);
+		ThreadPool pool(MakeSettings(options, workers));
+		BenchJob job;
+		vector<double> samples;
+		samples.reserve(options.latencySamples);
+
+		for (size_t i = 0; i < options.latencySamples; ++i)
+		{
+			job.callbackTime = 0;
+			job.submitTime = NowNs();
+			pool.Enqueue(&job);
+			while (job.callbackTime == 0)
+			{
+				if (pool.ExecuteCallbacks() == 0)
+				{
+					this_thread::yield();
+				}
+			}
+			samples.push_back((job.callbackTime - job.submitTime) / 1000.0);
+		}
+		PrintPercentiles("enqueue to callback", samples);
+	}
+
+	void BenchScaling(const Options& options, size_t maxWorkers)
+	{
+		printf("\nScaling (small jobs, %zu jobs)\n", options.jobs);
+		vector<BenchJob> jobs(options.jobs);
+		vector<IJob*> pointers;
+		for (auto& job : jobs)
+		{
+			pointers.push_back(&job);
+		}
+
+		double baseline = 0.0;
+		for (size_t workers = 1; workers <= maxWorkers; ++workers)
+		{
+			ThreadPool pool(MakeSettings(options, workers));
+			double jobsPerSecond = MeasureThroughput(pool, jobs, pointers, JobSizes[1].work);
+			if (workers == 1)
+			{
+				baseline = jobsPerSecond;
+			}
+			printf("  %3zu workers  %12.0f jobs/s  speedup %5.2fx\n", workers, jobsPerSecond, jobsPerSecond / baseline);
+		}
+	}
+
+	void PrintUsage()
+	{
+		printf("JobSystemBenchmark [--workers N] [--jobs N] [--samples N] [--fibers] [--lock-stats]\n"
+			"  --workers  highest worker count for the scaling run, default is the usable cores\n"
+			"  --jobs     jobs per throughput and enqueue run, default 20000\n"
+			"  --samples  latency samples, default 5000\n"
+			"  --fibers   run jobs on fibers\n"
+			"  --lock-stats  print lock contention after each throughput run\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--workers") && hasValue)
+			options.maxWorkers = strtoull(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--jobs") && hasValue)
+			options.jobs = max((size_t)1, (size_t)strtoull(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "--samples") && hasValue)
+			options.latencySamples = max((size_t)1, (size_t)strtoull(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "--fibers"))
+			options.useFibers = true;
+		else if (!strcmp(argv[i], "--lock-stats"))
+			options.lockStats = true;
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") ? 1 : 0;
+		}
+	}
+
+	LockStats::SetEnabled(options.lockStats);
+
+	auto topology = CpuTopology::Query();
+	size_t usableCores = topology.GetUsableCores();
+	size_t defaultWorkers = max((size_t)1, usableCores > 1 ? usableCores - 1 : 1);
+	if (options.maxWorkers == 0)
+	{
+		options.maxWorkers = defaultWorkers;
+	}
+
+	printf("Job system benchmark: %zu logical, %zu physical, %zu usable cores, %s\n",
+		topology.logicalCores, topology.physicalCores, usableCores, options.useFibers ? "fibers" : "threads");
+
+	BenchEnqueueCost(options, defaultWorkers);
+	BenchLatency(options, defaultWorkers);
+	BenchThroughput(options, defaultWorkers);
+	BenchCallbackRoundTrip(options, defaultWorkers);
+	BenchScaling(options, options.maxWorkers);
+	return 0;
+}
@@ -0,0 +1,197 @@
+// One producer thread handing items to one consumer thread, through
+// ConcurrentQueue and through SpscRing, single items and in bulk.
+// Run with --help for options.
+#include "ConcurrentQueue.h"
+#include "SpscRing.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+using Clock = chrono::steady_clock;
+
+namespace
+{
+	struct Options
+	{
+		size_t items = 2000000;
+		size_t capacity = 1024;
+		size_t bulkSize = 64;
+	};
+
+	struct Result
+	{
+		double seconds;
+		uint64_t checksum;
+	};
+
+	void PrintResult(const char* label, const Options& options, const Result& result, uint64_t expected)
+	{
+		printf("  %-34s %8.2f Mitems/s  %7.1f ns/item%s\n", label,
+			options.items / result.seconds / 1e6, result.seconds * 1e9 / options.items,
+			result.checksum == expected ? "" : "  CHECKSUM MISMATCH");
+	}
+
+	Result RunConcurrentQueue(const Options& options)
+	{
+		ConcurrentQueue<uint64_t> queue;
+		uint64_t checksum = 0;
+
+		auto start = Clock::now();
+		thread consumer([&]
+		{
+			for (size_t i = 0; i < options.items; ++i)
+			{
+				checksum += queue.Pop();
+			}
+		});
+		for (size_t i = 0; i < options.items; ++i)
+		{
+			queue.Push(i);
+		}
+		consumer.join();
+		return { chrono::duration<double>(Clock::now() - start).count(), checksum };
+	}
+
+	Result RunConcurrentQueueBulk(const Options& options)
+	{
+		ConcurrentQueue<uint64_t> queue;
+		uint64_t checksum = 0;
+
+		auto start = Clock::now();
+		thread consumer([&]
+		{
+			vector<uint64_t> drained;
+			size_t received = 0;
+			while (received < options.items)
+			{
+				drained.clear();
+				received += queue.PopAll(drained);
+				for (auto value : drained)
+				{
+					checksum += value;
+				}
+				if (drained.empty())
+				{
+					this_thread::yield();
+				}
+			}
+		});
+		for (size_t i = 0; i < options.items; ++i)
+		{
+			queue.Push(i);
+		}
+		consumer.join();
+		return { chrono::duration<double>(Clock::now() - start).count(), checksum };
+	}
+
+	Result RunSpscRing(const Options& options)
+	{
+		SpscRing<uint64_t> ring(options.capacity);
+		uint64_t checksum = 0;
+
+		auto start = Clock::now();
+		thread consumer([&]
+		{
+			for (size_t i = 0; i < options.items; ++i)
+			{
+				checksum += ring.Pop();
+			}
+		});
+		for (size_t i = 0; i < options.items; ++i)
+		{
+			ring.Push(i);
+		}
+		consumer.join();
+		return { chrono::duration<double>(Clock::now() - start).count(), checksum };
+	}
+
+	Result RunSpscRingBulk(const Options& options)
+	{
+		SpscRing<uint64_t> ring(options.capacity);
+		uint64_t checksum = 0;
+
+		auto start = Clock::now();
+		thread consumer([&]
+		{
+			vector<uint64_t> batch(options.bulkSize);
+			size_t received = 0;
+			while (received < options.items)
+			{
+				size_t count = ring.TryPopBulk(batch);
+				for (size_t i = 0; i < count; ++i)
+				{
+					checksum += batch[i];
+				}
+				received += count;
+				if (count == 0)
+				{
+					this_thread::yield();
+				}
+			}
+		});
+
+		vector<uint64_t> batch(options.bulkSize);
+		for (size_t first = 0; first < options.items; )
+		{
+			size_t count = min(options.bulkSize, options.items - first);
+			for (size_t i = 0; i < count; ++i)
+			{
+				batch[i] = first + i;
+			}
+
+			span<const uint64_t> pending(batch.data(), count);
+			while (!pending.empty())
+			{
+				size_t pushed = ring.TryPushBulk(pending);
+				pending = pending.subspan(pushed);
+				if (pushed == 0)
+				{
+					this_thread::yield();
+				}
+			}
+			first += count;
+		}
+		consumer.join();
+		return { chrono::duration<double>(Clock::now() - start).count(), checksum };
+	}
+
+	void PrintUsage()
+	{
+		printf("QueueBenchmark [--items N] [--capacity N] [--bulk N]\n"
+			"  --items     items handed from producer to consumer, default 2000000\n"
+			"  --capacity  SpscRing capacity, default 1024\n"
+			"  --bulk      items per bulk push/pop, default 64\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--items") && hasValue)
+			options.items = max((size_t)1, (size_t)strtoull(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "--capacity") && hasValue)
+			options.capacity = max((size_t)2, (size_t)strtoull(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "--bulk") && hasValue)
+			options.bulkSize = max((size_t)1, (size_t)strtoull(argv[++i], nullptr, 10));
+		else
+		{
+			PrintUsage();
+			return strcmp(argv[i], "--help") ? 1 : 0;
+		}
+	}
+
+	uint64_t expected = (uint64_t)options.items * (options.items - 1) / 2;
+	printf("SPSC handoff, %zu items, ring capacity %zu, bulk %zu, %u hardware threads\n",
+		options.items, options.capacity, options.bulkSize, thread::hardware_concurrency());
+
+	PrintResult("ConcurrentQueue Push/Pop", options, RunConcurrentQueue(options), expected);
+	PrintResult("ConcurrentQueue Push/PopAll", options, RunConcurrentQueueBulk(options), expected);
+	PrintResult("SpscRing Push/Pop", options, RunSpscRing(options), expected);
+	PrintResult("SpscRing TryPushBulk/TryPopBulk", options, RunSpscRingBulk(options), expected);
+	return 0;
+}
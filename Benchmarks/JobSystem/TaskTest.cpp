@@ -0,0 +1,209 @@
+// Drives Task<T> on a real ThreadPool: nested tasks that hop between workers
+// and the main thread, exceptions crossing awaits, a long loop of tasks that
+// finish synchronously (symmetric transfer keeps the stack flat) and frame
+// reuse by size class. Exits with 1 on any failure.
+#include "ThreadPool.h"
+#include "Task.h"
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+	int failures = 0;
+
+	void Check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	}
+
+	thread::id mainThread;
+	atomic<uint32_t> wrongThread{ 0 };
+
+	::Task<int> Leaf(ThreadPool& pool, int value)
+	{
+		co_await pool.Schedule();
+		if (this_thread::get_id() == mainThread)
+		{
+			wrongThread++;
+		}
+		co_return value * 2;
+	}
+
+	::Task<int> Middle(ThreadPool& pool, int value)
+	{
+		int first = co_await Leaf(pool, value);
+		int second = co_await Leaf(pool, value + 1);
+		co_return first + second;
+	}
+
+	::Task<int> Root(ThreadPool& pool, int value)
+	{
+		int sum = co_await Middle(pool, value);
+		co_await pool.SwitchToMainThread();
+		if (this_thread::get_id() != mainThread)
+		{
+			wrongThread++;
+		}
+		co_return sum + 1;
+	}
+
+	::Task<int> Throws(ThreadPool& pool)
+	{
+		co_await pool.Schedule();
+		throw runtime_error("step failed");
+		co_return 0;
+	}
+
+	::Task<void> CatchesNested(ThreadPool& pool, bool& caught)
+	{
+		try
+		{
+			co_await Throws(pool);
+		}
+		catch (const runtime_error&)
+		{
+			caught = true;
+		}
+		co_await pool.SwitchToMainThread();
+	}
+
+	::Task<int> Immediate(int value)
+	{
+		co_return value;
+	}
+
+	// Each await completes without suspending, without symmetric transfer
+	// every iteration would leave a frame on the stack
+	::Task<long long> SynchronousLoop(int count)
+	{
+		long long sum = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			sum += co_await Immediate(i);
+		}
+		co_return sum;
+	}
+
+	template<typename T>
+	void RunOnMainThread(ThreadPool& pool, vector<::Task<T>>& tasks)
+	{
+		for (auto& task : tasks)
+		{
+			task.Start();
+		}
+
+		auto deadline = chrono::steady_clock::now() + chrono::seconds(30);
+		bool done = false;
+		while (!done && chrono::steady_clock::now() < deadline)
+		{
+			pool.ExecuteCallbacks();
+			done = true;
+			for (auto& task : tasks)
+			{
+				done = done && task.IsDone();
+			}
+			this_thread::yield();
+		}
+		Check(done, "every task finished");
+	}
+
+	void TestNested(ThreadPool& pool)
+	{
+		printf("Nested tasks across Schedule and SwitchToMainThread\n");
+		const int taskCount = 2000;
+		vector<::Task<int>> tasks;
+		for (int i = 0; i < taskCount; ++i)
+		{
+			tasks.push_back(Root(pool, i));
+		}
+		RunOnMainThread(pool, tasks);
+
+		int wrong = 0;
+		for (int i = 0; i < taskCount; ++i)
+		{
+			// 2i + 2(i + 1) + 1
+			wrong += !tasks[i].IsDone() || tasks[i].GetResult() != 4 * i + 3;
+		}
+		Check(wrong == 0, "results of nested tasks");
+		Check(wrongThread == 0, "each step ran on the thread it switched to");
+	}
+
+	void TestException(ThreadPool& pool)
+	{
+		printf("Exception through a nested await\n");
+		bool caught = false;
+		vector<::Task<void>> tasks;
+		tasks.push_back(CatchesNested(pool, caught));
+		RunOnMainThread(pool, tasks);
+		Check(caught, "awaiter catches the exception of the awaited task");
+
+		vector<::Task<int>> direct;
+		direct.push_back(Throws(pool));
+		RunOnMainThread(pool, direct);
+		bool rethrown = false;
+		try
+		{
+			direct[0].GetResult();
+		}
+		catch (const runtime_error&)
+		{
+			rethrown = true;
+		}
+		Check(rethrown, "GetResult rethrows");
+	}
+
+	void TestSymmetricTransfer()
+	{
+		printf("One million synchronously completing awaits\n");
+#if defined(__GNUC__) && !defined(__clang__) && (!defined(__OPTIMIZE__) || defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__))
+		// GCC only turns the transfers into tail calls in optimized builds
+		// without sanitizers, elsewhere the stack still grows per await
+		printf("  skipped, needs an optimized GCC build\n");
+		return;
+#endif
+		const int count = 1000000;
+		auto task = SynchronousLoop(count);
+		task.Start();
+		Check(task.IsDone() && task.GetResult() == (long long)count * (count - 1) / 2, "loop result");
+	}
+
+	void TestFrameReuse()
+	{
+		printf("Frame reuse by size class\n");
+		// 100 and 120 bytes share the 128 byte class
+		void* frame = CoroutineFrameAllocator::Allocate(100);
+		CoroutineFrameAllocator::Free(frame, 100);
+		void* reused = CoroutineFrameAllocator::Allocate(120);
+		Check(reused == frame, "same class reuses the freed frame");
+
+		void* other = CoroutineFrameAllocator::Allocate(1000);
+		Check(other != reused, "other class gets its own frame");
+		CoroutineFrameAllocator::Free(other, 1000);
+		CoroutineFrameAllocator::Free(reused, 120);
+
+		// Too large to pool, goes straight to the heap
+		void* large = CoroutineFrameAllocator::Allocate(1 << 20);
+		CoroutineFrameAllocator::Free(large, 1 << 20);
+	}
+}
+
+int main()
+{
+	mainThread = this_thread::get_id();
+	ThreadPoolSettings settings;
+	settings.numberOfThreads = 4;
+	settings.numberOfIOThreads = 0;
+	ThreadPool pool(settings);
+
+	TestNested(pool);
+	TestException(pool);
+	TestSymmetricTransfer();
+	TestFrameReuse();
+
+	printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+// Headless OcclusionBuffer check: rasterizes a known quad, compares the depth
+// buffer against the analytic depth of the plane and tests boxes in front of,
+// behind, beside and on the quad, then tests walls and a Sponza like hall
+// against themselves. Exits with 1 on any failure.
+#include "OcclusionBuffer.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	const float NearZ = 0.1f;
+	const float FarZ = 100.0f;
+
+	int failures = 0;
+
+	void Check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	}
+
+	// Camera at the origin looking down +z, like the engine's default camera
+	XMMATRIX MakeViewProjection()
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(0.25f * XM_PI,
+			(float)OCCLUSION_BUFFER_WIDTH / OCCLUSION_BUFFER_HEIGHT, NearZ, FarZ);
+		return XMMatrixMultiply(view, projection);
+	}
+
+	// Post projection depth of a point at view distance z
+	float DepthAt(float z)
+	{
+		return FarZ / (FarZ - NearZ) * (1.0f - NearZ / z);
+	}
+
+	// Axis aligned quad facing the camera at distance z
+	OccluderMesh MakeQuad(float minX, float minY, float maxX, float maxY, float z)
+	{
+		OccluderMesh quad;
+		quad.positions = { XMFLOAT3(minX, minY, z), XMFLOAT3(minX, maxY, z), XMFLOAT3(maxX, maxY, z), XMFLOAT3(maxX, minY, z) };
+		quad.indices = { 0, 1, 2, 0, 2, 3 };
+		return quad;
+	}
+
+	BoundingBox MakeBox(float x, float y, float z, float extentX, float extentY, float extentZ)
+	{
+		return BoundingBox(XMFLOAT3(x, y, z), XMFLOAT3(extentX, extentY, extentZ));
+	}
+
+	void Render(OcclusionBuffer& buffer, const OccluderMesh& occluder)
+	{
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		buffer.BeginScene(MakeViewProjection());
+		buffer.AddOccluder(&occluder, identity);
+		buffer.Rasterize();
+	}
+
+	void TestDepthBuffer(ThreadPool& pool)
+	{
+		printf("Depth buffer of a quad at z = 10\n");
+		OcclusionBuffer buffer(pool);
+		OccluderMesh quad = MakeQuad(-2.0f, -2.0f, 2.0f, 2.0f, 10.0f);
+		Render(buffer, quad);
+
+		// Project the quad's corners to find the pixels whose centers it covers
+		XMMATRIX viewProjection = MakeViewProjection();
+		XMFLOAT4 low, high;
+		XMStoreFloat4(&low, XMVector3TransformCoord(XMVectorSet(-2.0f, 2.0f, 10.0f, 1.0f), viewProjection));
+		XMStoreFloat4(&high, XMVector3TransformCoord(XMVectorSet(2.0f, -2.0f, 10.0f, 1.0f), viewProjection));
+		float x0 = (low.x * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+		float x1 = (high.x * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+		float y0 = (0.5f - low.y * 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+		float y1 = (0.5f - high.y * 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+
+		const auto& depth = buffer.GetDepthBuffer();
+		float expected = DepthAt(10.0f);
+		uint32_t wrongInside = 0, wrongOutside = 0;
+		float maxError = 0.0f;
+		for (uint32_t y = 0; y < buffer.GetHeight(); ++y)
+		{
+			for (uint32_t x = 0; x < buffer.GetWidth(); ++x)
+			{
+				float centerX = x + 0.5f, centerY = y + 0.5f;
+				// Pixels within a hair of an edge may go either way
+				bool inside = centerX > x0 + 0.01f && centerX < x1 - 0.01f && centerY > y0 + 0.01f && centerY < y1 - 0.01f;
+				bool outside = centerX < x0 - 0.01f || centerX > x1 + 0.01f || centerY < y0 - 0.01f || centerY > y1 + 0.01f;
+				float stored = depth[y * buffer.GetWidth() + x];
+				if (inside)
+				{
+					maxError = std::max(maxError, fabsf(stored - expected));
+					wrongInside += fabsf(stored - expected) > 1e-5f;
+				}
+				else if (outside)
+				{
+					wrongOutside += stored != 1.0f;
+				}
+			}
+		}
+
+		printf("  covers [%.1f, %.1f] x [%.1f, %.1f], max depth error %g\n", x0, x1, y0, y1, maxError);
+		Check(wrongInside == 0, "pixels inside the quad hold its depth");
+		Check(wrongOutside == 0, "pixels outside the quad are cleared");
+		Check(buffer.GetStats().rasterizedTriangles == 2, "both triangles rasterized");
+	}
+
+	void TestVisibility(ThreadPool& pool)
+	{
+		printf("Boxes around a quad at z = 10\n");
+		OcclusionBuffer buffer(pool);
+		OccluderMesh quad = MakeQuad(-2.0f, -2.0f, 2.0f, 2.0f, 10.0f);
+		Render(buffer, quad);
+		XMMATRIX viewProjection = MakeViewProjection();
+
+		Check(!buffer.IsVisible(MakeBox(0.0f, 0.0f, 20.0f, 0.5f, 0.5f, 0.5f), viewProjection), "box behind the quad is hidden");
+		Check(buffer.IsVisible(MakeBox(0.0f, 0.0f, 5.0f, 0.5f, 0.5f, 0.5f), viewProjection), "box in front of the quad is visible");
+		Check(buffer.IsVisible(MakeBox(5.0f, 0.0f, 20.0f, 0.5f, 0.5f, 0.5f), viewProjection), "box beside the quad is visible");
+		Check(buffer.IsVisible(MakeBox(4.0f, 0.0f, 20.0f, 0.5f, 0.5f, 0.5f), viewProjection), "box over the edge of the quad is visible");
+		Check(buffer.IsVisible(MakeBox(0.0f, 0.0f, 10.5f, 0.5f, 0.5f, 1.0f), viewProjection), "box through the quad is visible");
+		Check(buffer.IsVisible(MakeBox(0.0f, 0.0f, 0.5f, 0.5f, 0.5f, 1.0f), viewProjection), "box through the near plane is visible");
+		Check(buffer.IsVisible(MakeBox(0.0f, 0.0f, 10.0f, 2.0f, 2.0f, 0.0f), viewProjection), "the quad's own bounds are visible");
+
+		// TestBoxes runs the same test in jobs
+		std::vector<BoundingBox> boxes;
+		for (int i = 0; i < 1000; ++i)
+		{
+			boxes.push_back(MakeBox((i % 2) ? 0.0f : 6.0f, 0.0f, 15.0f + i * 0.01f, 0.2f, 0.2f, 0.2f));
+		}
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		std::vector<uint8_t> visible;
+		buffer.TestBoxes(boxes, identity, visible);
+		uint32_t wrong = 0;
+		for (size_t i = 0; i < boxes.size(); ++i)
+		{
+			wrong += visible[i] != ((i % 2) ? 0 : 1);
+		}
+		Check(wrong == 0, "TestBoxes hides the boxes behind the quad only");
+		Check(buffer.GetStats().occluded == 500, "occluded count matches");
+	}
+
+	// Walls are their own occluders: the bounds of a wall lie in its plane and
+	// the wall must never hide them. Walls are axis aligned in model space and
+	// placed with a scaled world matrix, seen from random cameras, like Sponza.
+	void TestSelfOcclusion(ThreadPool& pool)
+	{
+		printf("Walls tested against themselves\n");
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		OcclusionBuffer buffer(pool);
+
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(0.25f * XM_PI,
+			(float)OCCLUSION_BUFFER_WIDTH / OCCLUSION_BUFFER_HEIGHT, NearZ, FarZ);
+		uint32_t hidden = 0, tested = 0;
+		const uint32_t wallCount = 4000;
+		for (uint32_t i = 0; i < wallCount; ++i)
+		{
+			// Model space wall in the plane z = depth, 50 times the world size
+			float depth = (unit(random) - 0.5f) * 2000.0f;
+			float halfWidth = 20.0f + unit(random) * 400.0f;
+			float halfHeight = 20.0f + unit(random) * 400.0f;
+			OccluderMesh wall = MakeQuad(-halfWidth, -halfHeight, halfWidth, halfHeight, depth);
+			BoundingBox bounds = MakeBox(0.0f, 0.0f, depth, halfWidth, halfHeight, 0.0f);
+
+			XMFLOAT4X4 worldTransposed;
+			XMMATRIX world = XMMatrixMultiply(XMMatrixScaling(0.02f, 0.02f, 0.02f), XMMatrixTranslation(0.0f, 0.0f, 10.0f));
+			XMStoreFloat4x4(&worldTransposed, XMMatrixTranspose(world));
+
+			// Somewhere in front of the wall, looking roughly at it. Every other
+			// camera faces the wall head on, the whole wall is then at the depth
+			// of its bounds.
+			float wallZ = 10.0f + depth * 0.02f;
+			XMVECTOR eye = XMVectorSet((unit(random) - 0.5f) * 20.0f, (unit(random) - 0.5f) * 10.0f, wallZ - 1.0f - unit(random) * 30.0f, 1.0f);
+			XMVECTOR target = XMVectorSet((unit(random) - 0.5f) * 8.0f, (unit(random) - 0.5f) * 8.0f, wallZ, 1.0f);
+			XMVECTOR direction = (i % 2) ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSubtract(target, eye);
+			XMMATRIX view = XMMatrixLookToLH(eye, direction, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+			buffer.BeginScene(XMMatrixMultiply(view, projection));
+			buffer.AddOccluder(&wall, worldTransposed);
+			buffer.Rasterize();
+			if (buffer.GetStats().rasterizedTriangles == 0)
+				continue;
+
+			std::vector<uint8_t> visible;
+			buffer.TestBoxes({ bounds }, worldTransposed, visible);
+			hidden += !visible[0];
+			tested++;
+		}
+
+		printf("  %u of %u walls on screen hid themselves\n", hidden, tested);
+		Check(tested > wallCount / 2, "most walls are on screen");
+		Check(hidden == 0, "no wall hides itself");
+	}
+
+	struct SubMesh
+	{
+		OccluderMesh occluder;
+		BoundingBox bounds;
+	};
+
+	// Box sub-mesh between two model space corners, flat when they share a
+	// coordinate. Its triangles are also appended to the whole model's occluder.
+	void AddSubMesh(XMFLOAT3 low, XMFLOAT3 high, float minArea, std::vector<SubMesh>& subMeshes, OccluderMesh& model)
+	{
+		XMFLOAT3 corners[8];
+		for (int i = 0; i < 8; ++i)
+		{
+			corners[i] = XMFLOAT3((i & 1) ? high.x : low.x, (i & 2) ? high.y : low.y, (i & 4) ? high.z : low.z);
+		}
+		const uint32_t indices[36] = {
+			0, 1, 3, 0, 3, 2,  4, 6, 7, 4, 7, 5,
+			0, 4, 5, 0, 5, 1,  2, 3, 7, 2, 7, 6,
+			0, 2, 6, 0, 6, 4,  1, 5, 7, 1, 7, 3,
+		};
+
+		SubMesh subMesh;
+		BoundingBox::CreateFromPoints(subMesh.bounds, 8, corners, sizeof(XMFLOAT3));
+		AppendOccluderTriangles(corners, sizeof(XMFLOAT3), indices, 36, minArea, subMesh.occluder);
+		AppendOccluderTriangles(corners, sizeof(XMFLOAT3), indices, 36, minArea, model);
+		subMeshes.push_back(std::move(subMesh));
+	}
+
+	// Sponza is an occluder for its own sub-meshes. A hall of Sponza's size in
+	// model units, with arcades, galleries and tiled walls, placed with the
+	// game's world matrix for Sponza and seen from the game's camera inside
+	// it. A sub-mesh that is the nearest surface at some pixel must be visible.
+	void TestSponzaSelfOcclusion(ThreadPool& pool)
+	{
+		printf("Sponza like hall tested against itself\n");
+		const float minX = -1900.0f, maxX = 1800.0f, height = 1500.0f, minZ = -1100.0f, maxZ = 1100.0f;
+		const float galleryHeight = 600.0f, arcadeZ = 500.0f;
+		XMFLOAT3 extents(0.5f * (maxX - minX), 0.5f * height, 0.5f * (maxZ - minZ));
+		float minArea = 4.0f * (extents.x * extents.x + extents.y * extents.y + extents.z * extents.z) * OCCLUDER_MIN_AREA_RATIO;
+
+		std::vector<SubMesh> subMeshes;
+		OccluderMesh model;
+		const int tilesX = 4, tilesY = 2, tilesZ = 2;
+		float tileX = (maxX - minX) / tilesX, tileY = height / tilesY, tileZ = (maxZ - minZ) / tilesZ;
+		for (int i = 0; i < tilesX; ++i)
+		{
+			for (int j = 0; j < tilesZ; ++j)
+			{
+				float x = minX + i * tileX, z = minZ + j * tileZ;
+				AddSubMesh(XMFLOAT3(x, 0.0f, z), XMFLOAT3(x + tileX, 0.0f, z + tileZ), minArea, subMeshes, model);
+				AddSubMesh(XMFLOAT3(x, height, z), XMFLOAT3(x + tileX, height, z + tileZ), minArea, subMeshes, model);
+			}
+			for (int j = 0; j < tilesY; ++j)
+			{
+				float x = minX + i * tileX, y = j * tileY;
+				AddSubMesh(XMFLOAT3(x, y, minZ), XMFLOAT3(x + tileX, y + tileY, minZ), minArea, subMeshes, model);
+				AddSubMesh(XMFLOAT3(x, y, maxZ), XMFLOAT3(x + tileX, y + tileY, maxZ), minArea, subMeshes, model);
+			}
+		}
+		for (int j = 0; j < tilesY; ++j)
+		{
+			for (int k = 0; k < tilesZ; ++k)
+			{
+				float y = j * tileY, z = minZ + k * tileZ;
+				AddSubMesh(XMFLOAT3(minX, y, z), XMFLOAT3(minX, y + tileY, z + tileZ), minArea, subMeshes, model);
+				AddSubMesh(XMFLOAT3(maxX, y, z), XMFLOAT3(maxX, y + tileY, z + tileZ), minArea, subMeshes, model);
+			}
+		}
+		// Galleries over the side aisles, columns along the arcades
+		AddSubMesh(XMFLOAT3(minX, galleryHeight, arcadeZ), XMFLOAT3(maxX, galleryHeight, maxZ), minArea, subMeshes, model);
+		AddSubMesh(XMFLOAT3(minX, galleryHeight, minZ), XMFLOAT3(maxX, galleryHeight, -arcadeZ), minArea, subMeshes, model);
+		for (float x = -1500.0f; x <= 1500.0f; x += 400.0f)
+		{
+			AddSubMesh(XMFLOAT3(x - 30.0f, 0.0f, arcadeZ - 30.0f), XMFLOAT3(x + 30.0f, galleryHeight, arcadeZ + 30.0f), minArea, subMeshes, model);
+			AddSubMesh(XMFLOAT3(x - 30.0f, 0.0f, -arcadeZ - 30.0f), XMFLOAT3(x + 30.0f, galleryHeight, -arcadeZ + 30.0f), minArea, subMeshes, model);
+		}
+
+		std::vector<BoundingBox> bounds;
+		for (auto& subMesh : subMeshes)
+		{
+			bounds.push_back(subMesh.bounds);
+		}
+
+		XMFLOAT4X4 worldTransposed;
+		XMMATRIX world = XMMatrixMultiply(XMMatrixScaling(0.02f, 0.02f, 0.02f), XMMatrixTranslation(0.0f, 0.0f, 10.0f));
+		XMStoreFloat4x4(&worldTransposed, XMMatrixTranspose(world));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(0.25f * XM_PI,
+			(float)OCCLUSION_BUFFER_WIDTH / OCCLUSION_BUFFER_HEIGHT, NearZ, FarZ);
+
+		// The game camera turned all around, then random spots in the nave
+		std::mt19937 random(2);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		OcclusionBuffer buffer(pool);
+		uint32_t hidden = 0, frontmost = 0, occluded = 0;
+		const int yawCount = 8, viewCount = 64;
+		for (int view = 0; view < viewCount; ++view)
+		{
+			XMVECTOR eye;
+			float yaw, pitch;
+			if (view < yawCount * 3)
+			{
+				eye = XMVectorSet(-21.386f, 4.0f, 10.733f, 1.0f);
+				yaw = (view % yawCount) * XM_2PI / yawCount;
+				pitch = (view / yawCount - 1) * 0.4f;
+			}
+			else
+			{
+				eye = XMVectorSet(-30.0f + unit(random) * 60.0f, 1.0f + unit(random) * 25.0f, 10.0f + (unit(random) - 0.5f) * 16.0f, 1.0f);
+				yaw = unit(random) * XM_2PI;
+				pitch = (unit(random) - 0.5f) * 1.2f;
+			}
+			XMVECTOR direction = XMVectorSet(sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch), 0.0f);
+			XMMATRIX viewProjection = XMMatrixMultiply(XMMatrixLookToLH(eye, direction, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)), projection);
+
+			buffer.BeginScene(viewProjection);
+			buffer.AddOccluder(&model, worldTransposed);
+			buffer.Rasterize();
+			std::vector<float> sceneDepth = buffer.GetDepthBuffer();
+			std::vector<uint8_t> visible;
+			buffer.TestBoxes(bounds, worldTransposed, visible);
+
+			// Alone, a sub-mesh draws the same depth where it is the nearest surface
+			for (size_t i = 0; i < subMeshes.size(); ++i)
+			{
+				buffer.BeginScene(viewProjection);
+				buffer.AddOccluder(&subMeshes[i].occluder, worldTransposed);
+				buffer.Rasterize();
+				const auto& depth = buffer.GetDepthBuffer();
+				bool isFrontmost = false;
+				for (size_t p = 0; p < depth.size() && !isFrontmost; ++p)
+				{
+					isFrontmost = depth[p] < 1.0f && depth[p] <= sceneDepth[p];
+				}
+				frontmost += isFrontmost;
+				hidden += isFrontmost && !visible[i];
+				occluded += !visible[i];
+			}
+		}
+
+		printf("  %zu sub-meshes, %u of %u nearest somewhere hid themselves, %u hidden in all\n",
+			subMeshes.size(), hidden, frontmost, occluded);
+		Check(frontmost > 0, "sub-meshes are on screen");
+		Check(occluded > 0, "the hall hides some of its sub-meshes");
+		Check(hidden == 0, "no sub-mesh in view is hidden by the hall");
+	}
+}
+
+int main()
+{
+	ThreadPoolSettings settings;
+	settings.numberOfThreads = 2;
+	ThreadPool pool(settings);
+
+	TestDepthBuffer(pool);
+	TestVisibility(pool);
+	TestSelfOcclusion(pool);
+	TestSponzaSelfOcclusion(pool);
+
+	printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
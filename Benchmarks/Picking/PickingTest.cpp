@@ -0,0 +1,105 @@
+// Headless check of the picking ray tests: a ray cast from inside a large box,
+// like the camera inside Sponza, has to pick the smaller box in front of it
+// instead of the box it starts in, and a click on the floor has to find the
+// point under the cursor. Exits with 1 on any failure.
+#include "RayPick.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	int failures = 0;
+
+	void Check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	}
+
+	BoundingOrientedBox MakeBox(XMFLOAT3 center, XMFLOAT3 extents)
+	{
+		BoundingOrientedBox box;
+		box.Center = center;
+		box.Extents = extents;
+		return box;
+	}
+
+	// Same nearest hit rule as SceneBVH::RayCast's leaves
+	int PickNearest(const std::vector<BoundingOrientedBox>& boxes, FXMVECTOR origin, FXMVECTOR direction)
+	{
+		int nearest = -1;
+		float distance = FLT_MAX;
+		for (int i = 0; i < (int)boxes.size(); ++i)
+		{
+			float hitDistance;
+			if (IntersectsRayAhead(boxes[i], origin, direction, hitDistance) && hitDistance < distance)
+			{
+				distance = hitDistance;
+				nearest = i;
+			}
+		}
+		return nearest;
+	}
+
+	void TestRayFromInside()
+	{
+		printf("Ray from inside a large box\n");
+		// Sponza sized level around the camera, a sphere sized box in front of it
+		std::vector<BoundingOrientedBox> boxes = {
+			MakeBox(XMFLOAT3(0.0f, 10.0f, 0.0f), XMFLOAT3(30.0f, 15.0f, 15.0f)),
+			MakeBox(XMFLOAT3(0.0f, 1.0f, 8.0f), XMFLOAT3(0.5f, 0.5f, 0.5f)),
+		};
+		XMVECTOR origin = XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f);
+		XMVECTOR forward = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		XMVECTOR back = XMVectorSet(0.0f, 0.0f, -1.0f, 0.0f);
+
+		float distance;
+		Check(!IntersectsRayAhead(boxes[0], origin, forward, distance), "the enclosing box is no hit");
+		Check(IntersectsRayAhead(boxes[1], origin, forward, distance) && distance > 7.0f && distance < 8.0f,
+			"the box in front is hit at its near face");
+		Check(PickNearest(boxes, origin, forward) == 1, "the box in front is picked");
+		Check(PickNearest(boxes, origin, back) == -1, "nothing is picked behind the camera");
+
+		// From outside the large box it is an ordinary hit again
+		XMVECTOR outside = XMVectorSet(0.0f, 1.0f, -20.0f, 1.0f);
+		Check(PickNearest(boxes, outside, forward) == 0, "the large box is picked from outside");
+	}
+
+	// The agent's sphere is picked from the game camera inside Sponza, then a
+	// click on the floor has to land on the path grid
+	void TestSelectThenClick()
+	{
+		printf("Select the agent, then click the floor\n");
+		std::vector<BoundingOrientedBox> boxes = {
+			MakeBox(XMFLOAT3(0.0f, 12.0f, 10.0f), XMFLOAT3(30.0f, 15.0f, 15.0f)),
+			MakeBox(XMFLOAT3(2.0f, 3.0f, 10.0f), XMFLOAT3(0.5f, 0.5f, 0.5f)),
+			MakeBox(XMFLOAT3(8.0f, 2.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f)),
+		};
+		XMVECTOR eye = XMVectorSet(-21.386f, 4.0f, 10.733f, 1.0f);
+		auto rayTo = [&](float x, float y, float z) { return XMVector3Normalize(XMVectorSubtract(XMVectorSet(x, y, z, 1.0f), eye)); };
+
+		Check(PickNearest(boxes, eye, rayTo(2.0f, 3.0f, 10.0f)) == 1, "the agent's sphere is picked");
+
+		XMFLOAT3 destination;
+		Check(IntersectsFloor(eye, rayTo(12.0f, 0.0f, 5.0f), destination), "a click below the horizon meets the floor");
+		Check(std::fabs(destination.x - 12.0f) < 1e-3f && std::fabs(destination.y) < 1e-3f && std::fabs(destination.z - 5.0f) < 1e-3f,
+			"the floor point is under the cursor");
+		Check(!IntersectsFloor(eye, rayTo(12.0f, 8.0f, 5.0f), destination), "a click above the horizon misses the floor");
+	}
+}
+
+int main()
+{
+	TestRayFromInside();
+	TestSelectThenClick();
+
+	printf(failures ? "%d checks failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -68,13 +68,18 @@ void AStar::Generator::clearCollisions()
 	walls.clear();
 }
 
-AStar::CoordinateList AStar::Generator::findPath(Vec2i source_, Vec2i target_)
+AStar::CoordinateList AStar::Generator::findPath(Vec2i source_, Vec2i target_, const std::atomic<bool>* cancelled_)
 {
 	Node *current = nullptr;
 	NodeSet openSet, closedSet;
 	openSet.insert(new Node(source_));
 
 	while (!openSet.empty()) {
+		if (cancelled_ && cancelled_->load(std::memory_order_relaxed)) {
+			current = nullptr;
+			break;
+		}
+
 		current = *openSet.begin();
 		for (auto node : openSet) {
 			if (node->getScore() <= current->getScore()) {
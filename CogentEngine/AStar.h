@@ -9,6 +9,7 @@ For more information visit https://opensource.org/licenses/ISC.
 #include <vector>
 #include <functional>
 #include <set>
+#include <atomic>
 
 namespace AStar
 {
@@ -46,7 +47,8 @@ namespace AStar
 		void setWorldSize(Vec2i worldSize_);
 		void setDiagonalMovement(bool enable_);
 		void setHeuristic(HeuristicFunction heuristic_);
-		CoordinateList findPath(Vec2i source_, Vec2i target_);
+		// Returns an empty path if cancelled_ is raised while searching
+		CoordinateList findPath(Vec2i source_, Vec2i target_, const std::atomic<bool>* cancelled_ = nullptr);
 		void addCollision(Vec2i coordinates_);
 		void removeCollision(Vec2i coordinates_);
 		void clearCollisions();
@@ -0,0 +1,13 @@
+#pragma once
+#include <atomic>
+
+// Flag a job polls to stop early once its result is no longer wanted.
+// Cancel may be called from any thread, the job decides where to check it.
+class CancellationToken
+{
+	std::atomic<bool> cancelled{ false };
+public:
+	void Cancel() { cancelled.store(true, std::memory_order_relaxed); }
+	bool IsCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+	const std::atomic<bool>* GetFlag() const { return &cancelled; }
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <DirectXMath.h>
+#include "AStar.h"
+#include "Constants.h"
+#include "ConstantBuffer.h"
+#include "Entity.h"
+
+// Components of the game's ECS world. Transform and render state stay with
+// the pooled Entity, components link to it and add what a system needs.
+
+struct RenderableComponent
+{
+	Entity* entity;
+};
+
+// Exactly one of the light pointers is set, matching type
+struct AreaLightComponent
+{
+	AreaLightType type;
+	SphereAreaLight* sphere;
+	DiscAreaLight* disc;
+	RectAreaLight* rect;
+};
+
+struct TransparencyComponent
+{
+	// Distance to the camera, transparent entities are drawn back to front
+	float linearDepth;
+};
+
+// With a RenderableComponent alongside, position is copied to that entity
+// on the main thread once the systems have run
+struct AgentComponent
+{
+	uint32_t agentId;
+	AStar::CoordinateList path;
+	int currentIndex;
+	float speed;
+	DirectX::XMFLOAT3 position;
+};
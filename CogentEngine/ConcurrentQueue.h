@@ -5,52 +5,81 @@
 #include <queue>
 #include <condition_variable>
 #include <mutex>
+#include <vector>
+#include "LockStats.h"
 using namespace std;
 
 template <typename T>
 class ConcurrentQueue
 {
-	queue<T> queue;
+	queue<T> items;
 	mutex mtx;
 	condition_variable cv;
+	LockStats lockStats;
 public:
 
 	T Pop();
 	void Push(const T& item);
 	bool IsEmpty();
 
-	ConcurrentQueue() {};
+	// Moves everything queued so far to the back of out, under a single lock
+	size_t PopAll(vector<T>& out);
+
+	// Contention counters, recorded while LockStats is enabled
+	LockStats& GetLockStats() { return lockStats; }
+
+	explicit ConcurrentQueue(const char* name = "ConcurrentQueue") : lockStats(name) {};
 	~ConcurrentQueue() {};
 };
 
 template<typename T>
 T ConcurrentQueue<T>::Pop()
 {
-	unique_lock<mutex> lock(mtx);
-	while (queue.empty())
+	InstrumentedLock lock(mtx, lockStats);
+	while (items.empty())
 	{
-		cv.wait(lock);
+		lock.Wait(cv);
 	}
 	//copies the item queued by popping
-	auto item = queue.front();
-	queue.pop();
+	auto item = items.front();
+	items.pop();
 	return item;
 }
 
 template<typename T>
 void ConcurrentQueue<T>::Push(const T &item)
 {
-	unique_lock<mutex> lock(mtx);
-	queue.push(item);
-	lock.unlock();
+	InstrumentedLock lock(mtx, lockStats);
+	items.push(item);
+	lockStats.RecordDepth(items.size());
+	lock.Unlock();
 	cv.notify_one();
+	lockStats.RecordNotify();
 }
 
 template<typename T>
 bool ConcurrentQueue<T>::IsEmpty()
 {
-	std::unique_lock<mutex> lock(mtx);
-	return queue.empty();
+	InstrumentedLock lock(mtx, lockStats);
+	return items.empty();
+}
+
+template<typename T>
+size_t ConcurrentQueue<T>::PopAll(vector<T>& out)
+{
+	queue<T> drained;
+	{
+		InstrumentedLock lock(mtx, lockStats);
+		swap(drained, items);
+	}
+
+	size_t count = drained.size();
+	while (!drained.empty())
+	{
+		out.push_back(move(drained.front()));
+		drained.pop();
+	}
+	return count;
 }
 
 
@@ -11,6 +11,61 @@ constexpr uint32_t MAX_CBUFFER_SIZE			= 1024 * 32;
 constexpr uint32_t FRAME_BUFFER_COUNT		= 3;
 constexpr uint32_t RENDER_TARGET_COUNT		= 32;
 constexpr uint32_t HEAPSIZE					= 4096;
+// Entities per job in the parallel entity update stage, small enough that
+// the demo scene's couple of dozen entities split into several jobs
+constexpr uint32_t ENTITY_UPDATE_BATCH_SIZE	= 8;
+// Capacity of the entity pool, entity storage is never reallocated
+constexpr uint32_t MAX_ENTITIES				= 1024;
+// Bytes per archetype chunk in the ECS world
+constexpr uint32_t ECS_CHUNK_SIZE			= 16 * 1024;
+// Scene BVH: items per leaf, and how much refitting may grow the summed node
+// area over the freshly built tree before a background rebuild starts
+constexpr uint32_t SCENE_BVH_LEAF_SIZE		= 4;
+constexpr float SCENE_BVH_REBUILD_RATIO		= 1.5f;
+// Boxes per frustum culling job, a multiple of the SIMD width of 4
+constexpr uint32_t FRUSTUM_CULL_BATCH_SIZE	= 256;
+// Software occlusion buffer. Both sizes must be multiples of the tile size,
+// and the tile width a multiple of 4.
+constexpr uint32_t OCCLUSION_BUFFER_WIDTH	= 320;
+constexpr uint32_t OCCLUSION_BUFFER_HEIGHT	= 176;
+constexpr uint32_t OCCLUSION_TILE_WIDTH		= 32;
+constexpr uint32_t OCCLUSION_TILE_HEIGHT	= 16;
+// Occluder vertices or triangles per job, and boxes per test job
+constexpr uint32_t OCCLUSION_TRIANGLE_BATCH_SIZE = 1024;
+constexpr uint32_t OCCLUSION_TEST_BATCH_SIZE	= 128;
+// Occluder triangles smaller than this fraction of the squared model
+// diagonal are dropped when the occluder is built
+constexpr float OCCLUDER_MIN_AREA_RATIO		= 1e-4f;
+// Post projection depth a box may lie behind the occluders and still count
+// as visible, about a centimeter at 10 units with the default camera
+constexpr float OCCLUSION_DEPTH_BIAS		= 1e-5f;
+// World units per spatial hash cell, about the usual query radius
+constexpr float SPATIAL_HASH_CELL_SIZE		= 4.0f;
+// Queries per job of a spatial hash query batch
+constexpr uint32_t SPATIAL_QUERY_BATCH_SIZE	= 64;
+// Path grid cells per side, cell x and y are world x and z
+constexpr int NAV_GRID_SIZE					= 20;
+
+/// Job System
+// 0 sizes the worker pool from the detected cores and cgroup quota
+constexpr uint32_t JOB_WORKER_COUNT			= 0;
+constexpr uint32_t JOB_IO_THREAD_COUNT		= 2;
+constexpr bool JOB_PIN_WORKERS				= false;
+// Idle workers spin, then yield, then sleep. Higher counts lower the latency
+// of short per-frame jobs at the cost of CPU time.
+constexpr uint32_t JOB_SPIN_COUNT			= 1000;
+constexpr uint32_t JOB_YIELD_COUNT			= 10;
+// Main thread time per frame for job callbacks, 0 runs all of them
+constexpr double JOB_CALLBACK_BUDGET_MS		= 2.0;
+// Frames written to JobTrace.json when F9 is pressed
+constexpr uint32_t JOB_TRACE_FRAME_COUNT	= 120;
+// Debug builds record lock contention and print it every this many frames, 0 turns it off
+constexpr uint32_t JOB_LOCK_STATS_LOG_FRAMES = 600;
+// Time-sliced background tasks share this much worker time per frame and
+// back off while frames run over the target
+constexpr double JOB_TARGET_FRAME_MS		= 1000.0 / 60.0;
+constexpr double JOB_BACKGROUND_BUDGET_MS	= 2.0;
+constexpr double JOB_BACKGROUND_MAX_BUDGET_MS = 4.0;
 
 constexpr float BG_COLOR[] = { 0.0f, 0.2f, 0.3f, 1.0f };
 
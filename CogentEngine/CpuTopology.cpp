@@ -0,0 +1,194 @@
+#include "CpuTopology.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <set>
+#include <utility>
+#endif
+
+#ifdef _WIN32
+
+CpuTopology CpuTopology::Query()
+{
+	CpuTopology topology;
+
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+	std::vector<char> buffer(length);
+	auto info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+
+	DWORD_PTR processMask = 0;
+	DWORD_PTR systemMask = 0;
+	GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+
+	std::vector<int> siblings;
+	size_t physical = 0;
+	if (length && GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length))
+	{
+		for (DWORD offset = 0; offset < length;)
+		{
+			auto entry = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+			offset += entry->Size;
+
+			// Affinity masks only cover processor group 0
+			if (entry->Processor.GroupMask[0].Group != 0)
+			{
+				continue;
+			}
+
+			auto mask = entry->Processor.GroupMask[0].Mask & processMask;
+			bool first = true;
+			for (int cpu = 0; cpu < int(sizeof(KAFFINITY) * 8); ++cpu)
+			{
+				if (mask & (KAFFINITY(1) << cpu))
+				{
+					(first ? topology.cpuIds : siblings).push_back(cpu);
+					first = false;
+				}
+			}
+			physical += mask ? 1 : 0;
+		}
+	}
+
+	topology.cpuIds.insert(topology.cpuIds.end(), siblings.begin(), siblings.end());
+	topology.logicalCores = std::max<size_t>(1, topology.cpuIds.size());
+	topology.physicalCores = std::max<size_t>(1, physical);
+
+	if (topology.cpuIds.empty())
+	{
+		topology.logicalCores = std::max(1u, std::thread::hardware_concurrency());
+		topology.physicalCores = topology.logicalCores;
+	}
+	return topology;
+}
+
+void CpuTopology::SetCurrentThreadName(const std::string& name)
+{
+	std::wstring wideName(name.begin(), name.end());
+	SetThreadDescription(GetCurrentThread(), wideName.c_str());
+}
+
+bool CpuTopology::PinCurrentThread(int cpuId)
+{
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpuId) != 0;
+}
+
+#else
+
+template<typename T>
+static bool ReadValue(const std::string& path, T& value)
+{
+	std::ifstream file(path);
+	return bool(file >> value);
+}
+
+// cgroup v2 exposes "quota period" in cpu.max, v1 splits them into two files
+static double ReadCgroupQuota()
+{
+	std::ifstream cpuMax("/sys/fs/cgroup/cpu.max");
+	std::string quota;
+	double period = 0.0;
+	if (cpuMax >> quota >> period)
+	{
+		return (quota == "max" || period <= 0.0) ? 0.0 : std::stod(quota) / period;
+	}
+
+	for (auto dir : { "/sys/fs/cgroup/cpu/", "/sys/fs/cgroup/cpu,cpuacct/" })
+	{
+		double quotaUs = 0.0;
+		double periodUs = 0.0;
+		if (ReadValue(std::string(dir) + "cpu.cfs_quota_us", quotaUs) &&
+			ReadValue(std::string(dir) + "cpu.cfs_period_us", periodUs))
+		{
+			return (quotaUs <= 0.0 || periodUs <= 0.0) ? 0.0 : quotaUs / periodUs;
+		}
+	}
+	return 0.0;
+}
+
+CpuTopology CpuTopology::Query()
+{
+	CpuTopology topology;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	std::vector<int> allowed;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+	{
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (CPU_ISSET(cpu, &set))
+			{
+				allowed.push_back(cpu);
+			}
+		}
+	}
+	else
+	{
+		for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+		{
+			allowed.push_back(int(cpu));
+		}
+	}
+
+	// A physical core is a unique (package, core) pair
+	std::set<std::pair<int, int>> cores;
+	std::vector<int> siblings;
+	for (auto cpu : allowed)
+	{
+		std::string topologyDir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+		int package = 0;
+		int core = cpu;
+		ReadValue(topologyDir + "physical_package_id", package);
+		ReadValue(topologyDir + "core_id", core);
+
+		if (cores.insert({ package, core }).second)
+		{
+			topology.cpuIds.push_back(cpu);
+		}
+		else
+		{
+			siblings.push_back(cpu);
+		}
+	}
+
+	topology.cpuIds.insert(topology.cpuIds.end(), siblings.begin(), siblings.end());
+	topology.logicalCores = std::max<size_t>(1, allowed.size());
+	topology.physicalCores = std::max<size_t>(1, cores.size());
+	topology.cpuQuota = ReadCgroupQuota();
+	return topology;
+}
+
+void CpuTopology::SetCurrentThreadName(const std::string& name)
+{
+	// The kernel limits thread names to 15 characters
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+}
+
+bool CpuTopology::PinCurrentThread(int cpuId)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpuId, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#endif
+
+size_t CpuTopology::GetUsableCores() const
+{
+	size_t cores = physicalCores;
+	if (cpuQuota > 0.0)
+	{
+		cores = std::min(cores, size_t(std::ceil(cpuQuota)));
+	}
+	return std::max<size_t>(1, cores);
+}
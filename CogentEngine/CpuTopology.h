@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// What the process is actually allowed to run on: logical and physical cores
+// within its affinity mask and, on Linux, the cgroup CPU quota of a container.
+class CpuTopology
+{
+public:
+	size_t logicalCores = 1;
+	size_t physicalCores = 1;
+
+	// Cores granted by a cgroup quota, 0 when unlimited
+	double cpuQuota = 0.0;
+
+	// Logical CPU ids the process may use. One CPU of every physical core
+	// comes first, SMT siblings follow, so pinning in order spreads out.
+	std::vector<int> cpuIds;
+
+	static CpuTopology Query();
+
+	// Cores worth running busy threads on: physical cores capped by the quota
+	size_t GetUsableCores() const;
+
+	static void SetCurrentThreadName(const std::string& name);
+	static bool PinCurrentThread(int cpuId);
+};
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "EcsWorld.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace
+{
+	// Fixed array so lookups never race with a registration growing it
+	ComponentInfo componentInfos[MAX_COMPONENT_TYPES];
+	uint32_t componentCount = 0;
+	std::mutex registryMutex;
+}
+
+ComponentId RegisterComponent(const ComponentInfo& info)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	if (componentCount >= MAX_COMPONENT_TYPES)
+	{
+		printf("ECS: more than %u component types, %s not registered\n", MAX_COMPONENT_TYPES, info.name);
+		std::abort();
+	}
+
+	componentInfos[componentCount] = info;
+	return componentCount++;
+}
+
+const ComponentInfo& GetComponentInfo(ComponentId id)
+{
+	return componentInfos[id];
+}
+
+EcsWorld::EcsWorld()
+{
+}
+
+EcsWorld::~EcsWorld()
+{
+	for (auto& archetype : archetypes)
+	{
+		for (auto& chunk : archetype->chunks)
+		{
+			for (ComponentId id : archetype->components)
+			{
+				for (uint32_t row = 0; row < chunk->count; ++row)
+				{
+					GetComponentInfo(id).destroy(archetype->GetComponent(*chunk, id, row));
+				}
+			}
+		}
+	}
+}
+
+EcsWorld::Archetype* EcsWorld::GetOrCreateArchetype(ComponentMask mask)
+{
+	auto it = archetypeMap.find(mask);
+	if (it != archetypeMap.end())
+		return it->second;
+
+	auto archetype = std::make_unique<Archetype>();
+	archetype->mask = mask;
+	size_t rowSize = sizeof(EcsEntity);
+	for (ComponentId id = 0; id < MAX_COMPONENT_TYPES; ++id)
+	{
+		if (mask & (ComponentMask(1) << id))
+		{
+			archetype->components.push_back(id);
+			rowSize += GetComponentInfo(id).size;
+		}
+	}
+
+	// Start from the unpadded row count and shrink until the aligned arrays fit
+	for (uint32_t capacity = (uint32_t)std::max<size_t>(1, ECS_CHUNK_SIZE / rowSize); capacity > 0; --capacity)
+	{
+		size_t offset = capacity * sizeof(EcsEntity);
+		for (ComponentId id : archetype->components)
+		{
+			const ComponentInfo& info = GetComponentInfo(id);
+			offset = (offset + info.alignment - 1) & ~(info.alignment - 1);
+			archetype->offsets[id] = offset;
+			offset += capacity * info.size;
+		}
+
+		if (offset <= ECS_CHUNK_SIZE)
+		{
+			archetype->chunkCapacity = capacity;
+			break;
+		}
+	}
+
+	Archetype* result = archetype.get();
+	archetypes.push_back(std::move(archetype));
+	archetypeMap[mask] = result;
+	return result;
+}
+
+EcsEntity EcsWorld::AllocateEntity()
+{
+	EcsEntity entity;
+	if (!freeRecords.empty())
+	{
+		entity.index = freeRecords.back();
+		freeRecords.pop_back();
+	}
+	else
+	{
+		entity.index = (uint32_t)records.size();
+		records.push_back(EntityRecord());
+	}
+
+	entity.generation = records[entity.index].generation;
+	liveCount++;
+	return entity;
+}
+
+void EcsWorld::AllocateRow(Archetype* archetype, EcsEntity entity)
+{
+	if (archetype->chunks.empty() || archetype->chunks.back()->count == archetype->chunkCapacity)
+	{
+		archetype->chunks.push_back(std::make_unique<Chunk>());
+	}
+
+	Chunk& chunk = *archetype->chunks.back();
+	EntityRecord& record = records[entity.index];
+	record.archetype = archetype;
+	record.chunk = (uint32_t)archetype->chunks.size() - 1;
+	record.row = chunk.count++;
+	archetype->GetEntities(chunk)[record.row] = entity;
+}
+
+void EcsWorld::RemoveRow(const EntityRecord& record)
+{
+	Archetype* archetype = record.archetype;
+	Chunk& hole = *archetype->chunks[record.chunk];
+	Chunk& last = *archetype->chunks.back();
+	uint32_t lastRow = last.count - 1;
+
+	if (&hole != &last || record.row != lastRow)
+	{
+		for (ComponentId id : archetype->components)
+		{
+			void* source = archetype->GetComponent(last, id, lastRow);
+			GetComponentInfo(id).moveConstruct(archetype->GetComponent(hole, id, record.row), source);
+			GetComponentInfo(id).destroy(source);
+		}
+
+		EcsEntity moved = archetype->GetEntities(last)[lastRow];
+		archetype->GetEntities(hole)[record.row] = moved;
+		records[moved.index].chunk = record.chunk;
+		records[moved.index].row = record.row;
+	}
+
+	if (--last.count == 0)
+	{
+		archetype->chunks.pop_back();
+	}
+}
+
+void EcsWorld::MoveEntity(EcsEntity entity, Archetype* target)
+{
+	EntityRecord source = records[entity.index];
+	Chunk& sourceChunk = *source.archetype->chunks[source.chunk];
+	AllocateRow(target, entity);
+
+	const EntityRecord& destination = records[entity.index];
+	Chunk& destinationChunk = *target->chunks[destination.chunk];
+	for (ComponentId id : source.archetype->components)
+	{
+		void* component = source.archetype->GetComponent(sourceChunk, id, source.row);
+		if (target->mask & (ComponentMask(1) << id))
+		{
+			GetComponentInfo(id).moveConstruct(target->GetComponent(destinationChunk, id, destination.row), component);
+		}
+		GetComponentInfo(id).destroy(component);
+	}
+
+	RemoveRow(source);
+}
+
+void EcsWorld::Destroy(EcsEntity entity)
+{
+	if (!IsAlive(entity))
+		return;
+
+	EntityRecord& record = records[entity.index];
+	Chunk& chunk = *record.archetype->chunks[record.chunk];
+	for (ComponentId id : record.archetype->components)
+	{
+		GetComponentInfo(id).destroy(record.archetype->GetComponent(chunk, id, record.row));
+	}
+
+	RemoveRow(record);
+	record.archetype = nullptr;
+	record.generation++;
+	freeRecords.push_back(entity.index);
+	liveCount--;
+}
+
+bool EcsWorld::IsAlive(EcsEntity entity) const
+{
+	return entity.index < records.size() && records[entity.index].archetype && records[entity.index].generation == entity.generation;
+}
+
+void* EcsWorld::GetComponent(EcsEntity entity, ComponentId id)
+{
+	if (!IsAlive(entity))
+		return nullptr;
+
+	const EntityRecord& record = records[entity.index];
+	if (!(record.archetype->mask & (ComponentMask(1) << id)))
+		return nullptr;
+
+	return record.archetype->GetComponent(*record.archetype->chunks[record.chunk], id, record.row);
+}
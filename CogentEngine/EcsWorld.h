@@ -0,0 +1,241 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Constants.h"
+
+// Archetype based entity-component storage. Every distinct set of component
+// types is an archetype, and its entities are packed into fixed size chunks
+// with one contiguous array per component. Queries walk only the archetypes
+// containing the requested components and hand out whole arrays, so systems
+// touch nothing but the data they asked for.
+
+using ComponentId = uint32_t;
+using ComponentMask = uint64_t;
+
+constexpr uint32_t MAX_COMPONENT_TYPES = 64;
+
+struct ComponentInfo
+{
+	const char* name;
+	size_t size;
+	size_t alignment;
+	void(*moveConstruct)(void* destination, void* source);
+	void(*destroy)(void* component);
+};
+
+// Component type ids are handed out on first use, process wide
+ComponentId RegisterComponent(const ComponentInfo& info);
+const ComponentInfo& GetComponentInfo(ComponentId id);
+
+template<typename T>
+ComponentId GetComponentId()
+{
+	static const ComponentId id = RegisterComponent({
+		typeid(T).name(),
+		sizeof(T),
+		alignof(T),
+		[](void* destination, void* source) { new (destination) T(std::move(*static_cast<T*>(source))); },
+		[](void* component) { static_cast<T*>(component)->~T(); }
+	});
+	return id;
+}
+
+struct EcsEntity
+{
+	static const uint32_t INVALID_INDEX = UINT32_MAX;
+
+	uint32_t index = INVALID_INDEX;
+	uint32_t generation = 0;
+
+	bool IsNull() const { return index == INVALID_INDEX; }
+	bool operator==(const EcsEntity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const EcsEntity& other) const { return !(*this == other); }
+};
+
+class EcsWorld
+{
+public:
+	EcsWorld();
+	~EcsWorld();
+
+	EcsWorld(const EcsWorld&) = delete;
+	EcsWorld& operator=(const EcsWorld&) = delete;
+
+	template<typename... Ts>
+	static ComponentMask MaskOf() { return (ComponentMask(0) | ... | (ComponentMask(1) << GetComponentId<Ts>())); }
+
+	// Structural changes, main thread only and never while systems run
+	template<typename... Ts>
+	EcsEntity Create(Ts&&... components);
+	void Destroy(EcsEntity entity);
+	template<typename T>
+	T& Add(EcsEntity entity, T&& component);
+	template<typename T>
+	void Remove(EcsEntity entity);
+
+	bool IsAlive(EcsEntity entity) const;
+	template<typename T>
+	bool Has(EcsEntity entity) const;
+	// Null if the entity is stale or lacks the component
+	template<typename T>
+	T* Get(EcsEntity entity);
+
+	// func(Ts&...) for every entity holding at least Ts
+	template<typename... Ts, typename Func>
+	void ForEach(Func&& func);
+	// func(count, Ts*...) once per chunk, the arrays are count long
+	template<typename... Ts, typename Func>
+	void ForEachChunk(Func&& func);
+
+	size_t GetEntityCount() const { return liveCount; }
+	size_t GetArchetypeCount() const { return archetypes.size(); }
+
+private:
+	struct Chunk
+	{
+		alignas(64) unsigned char data[ECS_CHUNK_SIZE];
+		uint32_t count = 0;
+	};
+
+	struct Archetype
+	{
+		ComponentMask mask = 0;
+		std::vector<ComponentId> components;
+		// Byte offset of each component array inside a chunk, by component id
+		size_t offsets[MAX_COMPONENT_TYPES] = {};
+		size_t entitiesOffset = 0;
+		uint32_t chunkCapacity = 0;
+		std::vector<std::unique_ptr<Chunk>> chunks;
+
+		void* GetComponent(Chunk& chunk, ComponentId id, uint32_t row) const
+		{
+			return chunk.data + offsets[id] + row * GetComponentInfo(id).size;
+		}
+		EcsEntity* GetEntities(Chunk& chunk) const { return reinterpret_cast<EcsEntity*>(chunk.data + entitiesOffset); }
+	};
+
+	struct EntityRecord
+	{
+		Archetype* archetype = nullptr;
+		uint32_t chunk = 0;
+		uint32_t row = 0;
+		uint32_t generation = 0;
+	};
+
+	Archetype* GetOrCreateArchetype(ComponentMask mask);
+	EcsEntity AllocateEntity();
+	void AllocateRow(Archetype* archetype, EcsEntity entity);
+	// Fills the hole at the record's row with the archetype's last row. The
+	// components at the hole must already be moved out or destroyed.
+	void RemoveRow(const EntityRecord& record);
+	// Moves the shared components to the target archetype, destroys the rest
+	void MoveEntity(EcsEntity entity, Archetype* target);
+	void* GetComponent(EcsEntity entity, ComponentId id);
+
+	template<typename... Ts, typename Func, size_t... I>
+	void ForEachChunkImpl(Func& func, std::index_sequence<I...>);
+
+	std::vector<std::unique_ptr<Archetype>> archetypes;
+	std::unordered_map<ComponentMask, Archetype*> archetypeMap;
+	std::vector<EntityRecord> records;
+	std::vector<uint32_t> freeRecords;
+	size_t liveCount = 0;
+};
+
+template<typename... Ts>
+inline EcsEntity EcsWorld::Create(Ts&&... components)
+{
+	EcsEntity entity = AllocateEntity();
+	Archetype* archetype = GetOrCreateArchetype(MaskOf<std::decay_t<Ts>...>());
+	AllocateRow(archetype, entity);
+
+	const EntityRecord& record = records[entity.index];
+	Chunk& chunk = *archetype->chunks[record.chunk];
+	(new (archetype->GetComponent(chunk, GetComponentId<std::decay_t<Ts>>(), record.row)) std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+	return entity;
+}
+
+template<typename T>
+inline T& EcsWorld::Add(EcsEntity entity, T&& component)
+{
+	using Type = std::decay_t<T>;
+	ComponentId id = GetComponentId<Type>();
+	if (void* existing = GetComponent(entity, id))
+	{
+		*static_cast<Type*>(existing) = std::forward<T>(component);
+		return *static_cast<Type*>(existing);
+	}
+
+	EntityRecord& record = records[entity.index];
+	MoveEntity(entity, GetOrCreateArchetype(record.archetype->mask | (ComponentMask(1) << id)));
+	void* slot = record.archetype->GetComponent(*record.archetype->chunks[record.chunk], id, record.row);
+	return *new (slot) Type(std::forward<T>(component));
+}
+
+template<typename T>
+inline void EcsWorld::Remove(EcsEntity entity)
+{
+	ComponentId id = GetComponentId<T>();
+	if (!GetComponent(entity, id))
+		return;
+
+	const EntityRecord& record = records[entity.index];
+	MoveEntity(entity, GetOrCreateArchetype(record.archetype->mask & ~(ComponentMask(1) << id)));
+}
+
+template<typename T>
+inline bool EcsWorld::Has(EcsEntity entity) const
+{
+	return IsAlive(entity) && (records[entity.index].archetype->mask & (ComponentMask(1) << GetComponentId<T>()));
+}
+
+template<typename T>
+inline T* EcsWorld::Get(EcsEntity entity)
+{
+	return static_cast<T*>(GetComponent(entity, GetComponentId<T>()));
+}
+
+template<typename... Ts, typename Func>
+inline void EcsWorld::ForEach(Func&& func)
+{
+	ForEachChunk<Ts...>([&func](uint32_t count, Ts*... arrays)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			func(arrays[i]...);
+		}
+	});
+}
+
+template<typename... Ts, typename Func>
+inline void EcsWorld::ForEachChunk(Func&& func)
+{
+	ForEachChunkImpl<Ts...>(func, std::index_sequence_for<Ts...>());
+}
+
+template<typename... Ts, typename Func, size_t... I>
+inline void EcsWorld::ForEachChunkImpl(Func& func, std::index_sequence<I...>)
+{
+	const ComponentId ids[] = { GetComponentId<Ts>()... };
+	ComponentMask mask = MaskOf<Ts...>();
+	for (auto& archetype : archetypes)
+	{
+		if ((archetype->mask & mask) != mask)
+			continue;
+
+		for (auto& chunk : archetype->chunks)
+		{
+			if (chunk->count)
+			{
+				func(chunk->count, reinterpret_cast<Ts*>(chunk->data + archetype->offsets[ids[I]])...);
+			}
+		}
+	}
+}
@@ -1,14 +1,15 @@
 #include "Entity.h"
+#include "TransformSystem.h"
 
 
 
-Entity::Entity(Mesh * mesh, GPUConstantBuffer* gpuConstantBuffer, const DescriptorHeap gpuHeap, uint32_t constantBufferIndex, Material* material, ConstantBufferView cbv)
+Entity::Entity(Mesh * mesh, GPUConstantBuffer* gpuConstantBuffer, const DescriptorHeap gpuHeap, uint32_t constantBufferIndex, Material* material, ConstantBufferView cbv, TransformSystem* transforms)
 {
 	this->mesh = mesh;
 	this->material = material;
 	this->constantBufferIndex = constantBufferIndex;
-	this->SetPosition(XMFLOAT3(0.0, 0.0, 0.0));
-	this->SetScale(XMFLOAT3(1.0, 1.0, 1.0));
+	this->transforms = transforms;
+	this->transformIndex = transforms->Create();
 	for (int i = 0; i < FRAME_BUFFER_COUNT; ++i)
 	{
 		this->cbv = cbv;
@@ -16,8 +17,9 @@ Entity::Entity(Mesh * mesh, GPUConstantBuffer* gpuConstantBuffer, const Descript
 		this->handle = gpuHeap.handleGPU(cbv.heapIndex);
 	}
 
-	//this->boundingOrientedBox = mesh->GetBoundingBox();
-
+	if (mesh)
+		transforms->SetLocalBounds(transformIndex, mesh->GetBoundingBox());
+	UpdateTransform();
 }
 
 Entity::~Entity()
@@ -26,58 +28,73 @@ Entity::~Entity()
 
 XMFLOAT3 Entity::GetPosition()
 {
-	return m_position;
+	return transforms->GetPosition(transformIndex);
 }
 
 XMFLOAT3 Entity::GetRotation()
 {
-	return m_rotation;
+	return transforms->GetRotation(transformIndex);
 }
 
 XMFLOAT3 Entity::GetScale()
 {
-	return m_scale;
+	return transforms->GetScale(transformIndex);
 }
 
 void Entity::SetPosition(XMFLOAT3 setPos)
 {
-	m_position = setPos;
+	transforms->SetPosition(transformIndex, setPos);
 }
 
 void Entity::SetScale(XMFLOAT3 setScale)
 {
-	m_scale = setScale;
-	//this->boundingOrientedBox = GetBoundingOrientedBox();
-	boundingOrientedBox.Extents.x *= setScale.x;
-	boundingOrientedBox.Extents.y *= setScale.y;
-	boundingOrientedBox.Extents.z *= setScale.z;
+	transforms->SetScale(transformIndex, setScale);
 }
 
 // Overload function if scale is uniform
 void Entity::SetScale(float scale)
 {
-	m_scale = XMFLOAT3(scale, scale, scale);
+	transforms->SetScale(transformIndex, XMFLOAT3(scale, scale, scale));
 }
 
 void Entity::SetRotation(XMFLOAT3 setRot)
 {
-	m_rotation.x = setRot.x * XM_PI / 180;
-	m_rotation.y = setRot.y * XM_PI / 180;
-	m_rotation.z = setRot.z * XM_PI / 180;
+	transforms->SetRotation(transformIndex, XMFLOAT3(
+		setRot.x * XM_PI / 180,
+		setRot.y * XM_PI / 180,
+		setRot.z * XM_PI / 180));
+}
+
+bool Entity::SetParent(Entity* parent)
+{
+	if (!transforms->SetParent(transformIndex, parent ? parent->transformIndex : INVALID_TRANSFORM))
+		return false;
+
+	this->parent = parent;
+	return true;
+}
+
+Entity* Entity::GetParent()
+{
+	return parent;
 }
 
 void Entity::Move(float x, float y, float z)
 {
-	m_position.x += x;
-	m_position.y += y;
-	m_position.z += z;
+	XMFLOAT3 position = GetPosition();
+	position.x += x;
+	position.y += y;
+	position.z += z;
+	SetPosition(position);
 }
 
 void Entity::Rotate(float x, float y, float z)
 {
-	m_rotation.x += x;
-	m_rotation.y += y;
-	m_rotation.z += z;
+	XMFLOAT3 rotation = GetRotation();
+	rotation.x += x;
+	rotation.y += y;
+	rotation.z += z;
+	transforms->SetRotation(transformIndex, rotation);
 }
 
 Mesh * Entity::GetMesh()
@@ -88,42 +105,41 @@ Mesh * Entity::GetMesh()
 void Entity::SetMesh(Mesh * mesh)
 {
 	this->mesh = mesh;
-	
+	if (mesh)
+		transforms->SetLocalBounds(transformIndex, mesh->GetBoundingBox());
 }
 
 XMFLOAT4X4 Entity::GetWorldMatrix()
 {
-	//coverting them to vectors
-	XMVECTOR vPosition = XMLoadFloat3(&m_position);
-	XMVECTOR vRotation = XMLoadFloat3(&m_rotation);
-	XMVECTOR vScale = XMLoadFloat3(&m_scale);
-
-	//coverting to matrices
-	XMMATRIX mPosition = XMMatrixTranslationFromVector(vPosition);
-	XMMATRIX mRotation = XMMatrixRotationRollPitchYawFromVector(vRotation);
-	XMMATRIX mScale = XMMatrixScalingFromVector(vScale);
-
-
-	XMMATRIX wake = XMMatrixIdentity();
-
-	//calculte world matrix
-	XMMATRIX world = mScale * mRotation * mPosition;
+	transforms->UpdateIfDirty(transformIndex);
+	return transforms->GetWorldMatrix(transformIndex);
+}
 
-	//storing the world matrix
+void Entity::UpdateTransform()
+{
+	transforms->UpdateIfDirty(transformIndex);
+}
 
-	XMStoreFloat4x4(&m_worldMatrix, XMMatrixTranspose(world));
+const BoundingOrientedBox& Entity::GetWorldBounds()
+{
+	transforms->UpdateIfDirty(transformIndex);
+	return transforms->GetWorldBounds(transformIndex);
+}
 
-	return m_worldMatrix;
+const BoundingBox& Entity::GetWorldAABB()
+{
+	transforms->UpdateIfDirty(transformIndex);
+	return transforms->GetWorldAABB(transformIndex);
 }
 
-void Entity::UpdateWorldMatrix()
+EntityHandle Entity::GetEntityHandle()
 {
-	XMMATRIX trans = XMMatrixTranslation(m_position.x, m_position.y, m_position.z);
-	XMMATRIX rot = XMMatrixRotationRollPitchYaw(m_rotation.x, m_rotation.y, m_rotation.z);
-	XMMATRIX sc = XMMatrixScaling(m_scale.x, m_scale.y, m_scale.z);
+	return entityHandle;
+}
 
-	XMMATRIX total = sc * rot * trans;
-	XMStoreFloat4x4(&m_worldMatrix, XMMatrixTranspose(total));
+uint32_t Entity::GetTransformIndex()
+{
+	return transformIndex;
 }
 
 char * Entity::GetAddress()
@@ -168,15 +184,7 @@ void Entity::SetSRVHandle(D3D12_GPU_DESCRIPTOR_HANDLE srvHandle)
 
 BoundingOrientedBox & Entity::GetBoundingOrientedBox()
 {
-	box = mesh->GetBoundingBox();
-	box.Center = m_position;
-	box.Extents.x *= m_scale.x;
-	box.Extents.y *= m_scale.y;
-	box.Extents.z *= m_scale.z;
-	XMVECTOR quaternion = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&m_rotation));
-	XMFLOAT4 rotationQuaternion;
-	XMStoreFloat4(&rotationQuaternion, quaternion);
-	box.Orientation = rotationQuaternion;
+	box = GetWorldBounds();
 	return box;
 }
 
@@ -5,11 +5,17 @@
 #include "Mesh.h"
 #include "Material.h"
 #include "ConstantBufferView.h"
+#include "EntityHandle.h"
 using namespace DirectX;
+
+class TransformSystem;
+
+// Position, rotation and scale live in the TransformSystem, the entity keeps
+// its index there next to the render state. Entities live in an EntityPool.
 class Entity
 {
 public:
-	Entity(Mesh* mesh, GPUConstantBuffer* gpuConstantBuffer, const DescriptorHeap gpuHeap, uint32_t constantBufferIndex, Material* material, ConstantBufferView cbv);
+	Entity(Mesh* mesh, GPUConstantBuffer* gpuConstantBuffer, const DescriptorHeap gpuHeap, uint32_t constantBufferIndex, Material* material, ConstantBufferView cbv, TransformSystem* transforms);
 	~Entity();
 
 	XMFLOAT3 GetPosition(); 
@@ -21,6 +27,10 @@ public:
 	void SetScale(float scale);
 	void SetRotation(XMFLOAT3 rotation);
 
+	// Position, rotation and scale become relative to the parent. Null detaches.
+	bool SetParent(Entity* parent);
+	Entity* GetParent();
+
 	void Move(float x, float y, float z);
 	void Rotate(float x, float y, float z);
 
@@ -30,8 +40,17 @@ public:
 	Material* GetMaterial();
 	void SetMaterial(Material* material);
 
+	// Cached in the TransformSystem, the entity update stage refreshes it every
+	// frame. A dirty transform is recomputed on access, which writes the
+	// TransformSystem, so these are main thread only. Jobs get positions or
+	// bounds gathered on the main thread instead.
 	XMFLOAT4X4 GetWorldMatrix();
-	void UpdateWorldMatrix();
+	// World matrix and world space bounds of this entity alone
+	void UpdateTransform();
+	const BoundingOrientedBox& GetWorldBounds();
+	const BoundingBox& GetWorldAABB();
+	uint32_t GetTransformIndex();
+	EntityHandle GetEntityHandle();
 	char* GetAddress();
 	uint32_t GetConstantBufferIndex();
 	ConstantBufferView GetConstantBufferView();
@@ -43,10 +62,12 @@ public:
 	BoundingOrientedBox& GetBoundingOrientedBox();
 
 private:
-	XMFLOAT4X4 m_worldMatrix;
-	XMFLOAT3 m_position;
-	XMFLOAT3 m_rotation;
-	XMFLOAT3 m_scale;
+	friend class EntityPool;
+
+	EntityHandle entityHandle;
+	TransformSystem* transforms;
+	uint32_t transformIndex;
+	Entity* parent = nullptr;
 	Mesh* mesh;
 	uint32_t constantBufferIndex;
 	Material* material;
@@ -54,7 +75,6 @@ private:
 	D3D12_GPU_DESCRIPTOR_HANDLE handle;
 	D3D12_GPU_DESCRIPTOR_HANDLE srvHandle;
 	UINT64 handlePtr;
-	BoundingOrientedBox boundingOrientedBox;
 	BoundingOrientedBox box;
 	ConstantBufferView cbv;
 
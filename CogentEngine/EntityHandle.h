@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+// Slot index plus the generation the slot had when the entity was created.
+// The generation changes when the entity is destroyed, so stale handles are
+// detected instead of resolving to whatever reuses the slot.
+struct EntityHandle
+{
+	static const uint32_t INVALID_INDEX = UINT32_MAX;
+
+	uint32_t index = INVALID_INDEX;
+	uint32_t generation = 0;
+
+	bool IsNull() const { return index == INVALID_INDEX; }
+	bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+	bool operator<(const EntityHandle& other) const { return index != other.index ? index < other.index : generation < other.generation; }
+};
@@ -0,0 +1,56 @@
+#include "EntityPool.h"
+#include "TransformSystem.h"
+
+EntityPool::EntityPool(uint32_t capacity)
+	: capacity(capacity)
+	, storage(new Slot[capacity])
+	, generations(capacity, 0)
+	, alive(capacity, 0)
+{
+	freeSlots.reserve(capacity);
+}
+
+EntityPool::~EntityPool()
+{
+	for (uint32_t i = 0; i < highWater; ++i)
+	{
+		if (alive[i])
+		{
+			GetSlot(i)->~Entity();
+		}
+	}
+}
+
+bool EntityPool::Destroy(EntityHandle handle)
+{
+	if (!IsValid(handle))
+		return false;
+
+	// Children are detached in the TransformSystem, drop their links too
+	Entity* entity = GetSlot(handle.index);
+	ForEach([entity](Entity* other)
+	{
+		if (other->parent == entity)
+		{
+			other->parent = nullptr;
+		}
+	});
+	entity->transforms->Destroy(entity->transformIndex);
+
+	entity->~Entity();
+	alive[handle.index] = 0;
+	generations[handle.index]++;
+	freeSlots.push_back(handle.index);
+	liveCount--;
+	return true;
+}
+
+bool EntityPool::IsValid(EntityHandle handle) const
+{
+	return handle.index < highWater && alive[handle.index] && generations[handle.index] == handle.generation;
+}
+
+Entity* EntityPool::Get(EntityHandle handle) const
+{
+	return IsValid(handle) ? GetSlot(handle.index) : nullptr;
+}
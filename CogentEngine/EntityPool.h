@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include "Entity.h"
+#include "EntityHandle.h"
+
+// Fixed capacity, contiguous storage for entities. Slots are reused through
+// a free list, so Entity pointers stay valid until the entity is destroyed
+// and lookups by handle are a bounds check plus a generation compare.
+class EntityPool
+{
+public:
+	EntityPool(uint32_t capacity);
+	~EntityPool();
+
+	EntityPool(const EntityPool&) = delete;
+	EntityPool& operator=(const EntityPool&) = delete;
+
+	// Returns a null handle when the pool is full
+	template<typename... Args>
+	EntityHandle Create(Args&&... args);
+	// Also frees the entity's transform, its children become roots
+	bool Destroy(EntityHandle handle);
+
+	bool IsValid(EntityHandle handle) const;
+	// Null for stale or null handles
+	Entity* Get(EntityHandle handle) const;
+
+	uint32_t GetCount() const { return liveCount; }
+	uint32_t GetCapacity() const { return capacity; }
+
+	// Visits live entities in slot order
+	template<typename Func>
+	void ForEach(Func&& func);
+
+private:
+	Entity* GetSlot(uint32_t index) const { return reinterpret_cast<Entity*>(&storage[index]); }
+
+	struct alignas(Entity) Slot
+	{
+		unsigned char bytes[sizeof(Entity)];
+	};
+
+	uint32_t capacity;
+	uint32_t liveCount = 0;
+	// Slots below highWater have been used at least once
+	uint32_t highWater = 0;
+	std::unique_ptr<Slot[]> storage;
+	std::vector<uint32_t> generations;
+	std::vector<uint8_t> alive;
+	std::vector<uint32_t> freeSlots;
+};
+
+template<typename... Args>
+inline EntityHandle EntityPool::Create(Args&&... args)
+{
+	uint32_t index;
+	if (!freeSlots.empty())
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else if (highWater < capacity)
+	{
+		index = highWater++;
+	}
+	else
+	{
+		return EntityHandle();
+	}
+
+	Entity* entity = new (GetSlot(index)) Entity(std::forward<Args>(args)...);
+	alive[index] = 1;
+	liveCount++;
+
+	EntityHandle handle;
+	handle.index = index;
+	handle.generation = generations[index];
+	entity->entityHandle = handle;
+	return handle;
+}
+
+template<typename Func>
+inline void EntityPool::ForEach(Func&& func)
+{
+	for (uint32_t i = 0; i < highWater; ++i)
+	{
+		if (alive[i])
+		{
+			func(GetSlot(i));
+		}
+	}
+}
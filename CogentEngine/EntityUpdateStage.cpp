@@ -0,0 +1,41 @@
+#include "EntityUpdateStage.h"
+
+EntityUpdateStage::EntityUpdateStage(ThreadPool& pool, TransformSystem& transforms, size_t batchSize)
+	: pool(pool), transforms(transforms), batchSize(batchSize > 0 ? batchSize : 1)
+{
+}
+
+void EntityUpdateStage::Run(const std::vector<Entity*>& entities, std::function<void(Entity*, size_t)> animate)
+{
+	batchCount = (entities.size() + batchSize - 1) / batchSize;
+	if (batchCount > 0 && animate)
+	{
+		RunAnimation(entities, std::move(animate));
+	}
+
+	transforms.UpdateAll(pool, batchSize);
+}
+
+void EntityUpdateStage::RunAnimation(const std::vector<Entity*>& entities, std::function<void(Entity*, size_t)> animate)
+{
+	// Jobs are reused across frames, only grow the pool of them
+	while (jobs.size() < batchCount)
+	{
+		jobs.push_back(std::make_unique<EntityUpdateJob>());
+	}
+
+	this->animate = std::move(animate);
+	jobPointers.clear();
+	for (size_t i = 0; i < batchCount; ++i)
+	{
+		EntityUpdateJob* job = jobs[i].get();
+		job->entities = entities.data();
+		job->first = i * batchSize;
+		job->count = std::min(batchSize, entities.size() - job->first);
+		job->animate = &this->animate;
+		jobPointers.push_back(job);
+	}
+
+	pool.EnqueueBatch(jobPointers, &counter, JobPriority::Critical);
+	pool.WaitForCounter(&counter);
+}
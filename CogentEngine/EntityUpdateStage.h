@@ -0,0 +1,38 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "ThreadPool.h"
+#include "Job.h"
+#include "TransformSystem.h"
+
+// Updates every entity's animation, world matrix and bounds on the job system
+// and joins before returning. Work is cut into fixed size batches by index,
+// so the result does not depend on the number of workers.
+class EntityUpdateStage
+{
+public:
+	EntityUpdateStage(ThreadPool& pool, TransformSystem& transforms, size_t batchSize);
+
+	// animate runs in batches over entities first and may only touch the
+	// entity it is given: setting its position, rotation or scale is fine,
+	// world matrices and bounds are main thread only until this returns.
+	// World matrices and bounds of all transforms are then rebuilt in SIMD
+	// batches. The main thread helps until all batches are done.
+	void Run(const std::vector<Entity*>& entities, std::function<void(Entity*, size_t)> animate = nullptr);
+
+	size_t GetBatchCount() const { return batchCount; }
+	size_t GetBatchSize() const { return batchSize; }
+
+private:
+	void RunAnimation(const std::vector<Entity*>& entities, std::function<void(Entity*, size_t)> animate);
+
+	ThreadPool& pool;
+	TransformSystem& transforms;
+	size_t batchSize;
+	size_t batchCount = 0;
+	std::function<void(Entity*, size_t)> animate;
+	std::vector<std::unique_ptr<EntityUpdateJob>> jobs;
+	std::vector<IJob*> jobPointers;
+	JobCounter counter;
+};
@@ -0,0 +1,90 @@
+#include "Fiber.h"
+#include <cstdint>
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+Fiber::~Fiber()
+{
+#ifdef _WIN32
+	if (handle && !isThreadFiber)
+	{
+		DeleteFiber(handle);
+	}
+#endif
+}
+
+#ifdef _WIN32
+
+void Fiber::Create(size_t stackSize, EntryPoint entry, void* userData)
+{
+	this->entry = entry;
+	this->userData = userData;
+	handle = CreateFiber(stackSize, (LPFIBER_START_ROUTINE)&Fiber::Start, this);
+}
+
+void Fiber::ConvertCurrentThread()
+{
+	isThreadFiber = true;
+	handle = ConvertThreadToFiber(nullptr);
+}
+
+void Fiber::RevertCurrentThread()
+{
+	ConvertFiberToThread();
+	handle = nullptr;
+}
+
+void Fiber::SwitchTo(Fiber& target)
+{
+	SwitchToFiber(target.handle);
+}
+
+void __stdcall Fiber::Start(void* fiber)
+{
+	auto self = static_cast<Fiber*>(fiber);
+	self->entry(self->userData);
+}
+
+#else
+
+void Fiber::Create(size_t stackSize, EntryPoint entry, void* userData)
+{
+	this->entry = entry;
+	this->userData = userData;
+	stack.resize(stackSize);
+
+	getcontext(&context);
+	context.uc_stack.ss_sp = stack.data();
+	context.uc_stack.ss_size = stack.size();
+	context.uc_link = nullptr;
+
+	// makecontext only forwards int arguments, so the pointer is split in two
+	auto address = reinterpret_cast<uintptr_t>(this);
+	makecontext(&context, (void(*)())&Fiber::Start, 2,
+		(unsigned int)(uint64_t(address) >> 32), (unsigned int)(uint64_t(address) & 0xffffffff));
+}
+
+void Fiber::ConvertCurrentThread()
+{
+	isThreadFiber = true;
+	getcontext(&context);
+}
+
+void Fiber::RevertCurrentThread()
+{
+}
+
+void Fiber::SwitchTo(Fiber& target)
+{
+	swapcontext(&context, &target.context);
+}
+
+void Fiber::Start(unsigned int high, unsigned int low)
+{
+	auto self = reinterpret_cast<Fiber*>(uintptr_t((uint64_t(high) << 32) | uint64_t(low)));
+	self->entry(self->userData);
+}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#ifndef _WIN32
+#include <ucontext.h>
+#endif
+
+// Thin wrapper around a user-mode execution context. On Windows this is a
+// native fiber, elsewhere it is a ucontext with its own heap-allocated stack.
+class Fiber
+{
+public:
+	using EntryPoint = void(*)(void* userData);
+
+	Fiber() {};
+	~Fiber();
+
+	Fiber(const Fiber&) = delete;
+	Fiber& operator=(const Fiber&) = delete;
+
+	// Creates a fiber with its own stack that starts in entry(userData) on the first switch
+	void Create(size_t stackSize, EntryPoint entry, void* userData);
+
+	// Turns the calling thread into a fiber so it can switch to other fibers and back
+	void ConvertCurrentThread();
+	void RevertCurrentThread();
+
+	// Saves the running context into this fiber and resumes target
+	void SwitchTo(Fiber& target);
+
+private:
+	EntryPoint entry = nullptr;
+	void* userData = nullptr;
+	bool isThreadFiber = false;
+
+#ifdef _WIN32
+	void* handle = nullptr;
+	static void __stdcall Start(void* fiber);
+#else
+	ucontext_t context;
+	std::vector<char> stack;
+	static void Start(unsigned int high, unsigned int low);
+#endif
+};
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "FrameBudgetScheduler.h"
+#include "JobProfiler.h"
+#include <algorithm>
+#include <chrono>
+
+using Clock = chrono::steady_clock;
+
+FrameBudgetScheduler::FrameBudgetScheduler(ThreadPool& pool, FrameBudgetSettings settings)
+	: pool(pool), settings(settings), budgetMs(settings.initialBudgetMs)
+{
+	stats.smoothedFrameMs = settings.targetFrameMs;
+	stats.budgetMs = budgetMs;
+}
+
+FrameBudgetScheduler::~FrameBudgetScheduler()
+{
+	// Slices hold pointers into tasks, they have to return first
+	pool.WaitForCounter(&slicesCounter);
+}
+
+void FrameBudgetScheduler::Add(ITimeSlicedTask* task)
+{
+	addedTasks.push_back(task);
+}
+
+void FrameBudgetScheduler::Remove(ITimeSlicedTask* task)
+{
+	addedTasks.erase(remove(addedTasks.begin(), addedTasks.end(), task), addedTasks.end());
+
+	auto it = find_if(tasks.begin(), tasks.end(), [task](const Entry& entry) { return entry.task == task; });
+	if (it == tasks.end())
+		return;
+
+	// The caller may delete the task right after, don't leave a slice running on it
+	pool.WaitForCounter(&slicesCounter);
+	CollectSlices();
+	tasks.erase(remove_if(tasks.begin(), tasks.end(), [task](const Entry& entry) { return entry.task == task; }), tasks.end());
+}
+
+void FrameBudgetScheduler::Update(float deltaTime)
+{
+	// Slices from last frame still running means the budget was overrun,
+	// leave them be and hand out nothing new this frame
+	if (!slicesCounter.IsZero())
+	{
+		stats.overrunFrames++;
+		return;
+	}
+
+	CollectSlices();
+	UpdateBudget(deltaTime * 1000.0);
+
+	for (auto task : addedTasks)
+	{
+		tasks.push_back({ task, false });
+	}
+	addedTasks.clear();
+	stats.activeTasks = tasks.size();
+
+	if (tasks.empty())
+		return;
+
+	if (budgetMs <= 0.0)
+	{
+		stats.throttledFrames++;
+		return;
+	}
+
+	Dispatch();
+}
+
+void FrameBudgetScheduler::UpdateBudget(double frameMs)
+{
+	stats.smoothedFrameMs += (frameMs - stats.smoothedFrameMs) * settings.frameSmoothing;
+
+	if (stats.smoothedFrameMs > settings.targetFrameMs)
+	{
+		budgetMs *= settings.shrinkFactor;
+		if (budgetMs < settings.minBudgetMs)
+			budgetMs = 0.0;
+	}
+	else if (settings.targetFrameMs - stats.smoothedFrameMs > budgetMs)
+	{
+		budgetMs = min(settings.maxBudgetMs, max(budgetMs, settings.minBudgetMs) + settings.growMs);
+	}
+	stats.budgetMs = budgetMs;
+}
+
+void FrameBudgetScheduler::CollectSlices()
+{
+	if (!hasSlicesInFlight)
+		return;
+	hasSlicesInFlight = false;
+
+	stats.usedMs = usedNanoseconds.exchange(0, memory_order_relaxed) / 1e6;
+	stats.utilisation = stats.budgetMs > 0.0 ? stats.usedMs / stats.budgetMs : 0.0;
+	utilisationSum += stats.utilisation;
+	stats.averageUtilisation = utilisationSum / stats.dispatchedFrames;
+
+	for (auto& entry : tasks)
+	{
+		if (entry.isDone)
+		{
+			entry.task->OnComplete();
+			stats.tasksCompleted++;
+		}
+	}
+	tasks.erase(remove_if(tasks.begin(), tasks.end(), [](const Entry& entry) { return entry.isDone; }), tasks.end());
+	stats.activeTasks = tasks.size();
+}
+
+void FrameBudgetScheduler::Dispatch()
+{
+	// Even split, each task gets at least one step so nothing starves
+	auto sliceBudget = chrono::duration_cast<Clock::duration>(
+		chrono::duration<double, milli>(budgetMs / tasks.size()));
+
+	hasSlicesInFlight = true;
+	stats.dispatchedFrames++;
+
+	auto& profiler = JobProfiler::Get();
+	uint64_t enqueueTime = profiler.IsEnabled() ? profiler.Now() : 0;
+
+	for (auto& entry : tasks)
+	{
+		Entry* slice = &entry;
+		pool.Post([this, slice, sliceBudget, enqueueTime, &profiler]
+		{
+			uint64_t startTime = enqueueTime ? profiler.Now() : 0;
+			auto start = Clock::now();
+			auto end = start + sliceBudget;
+			auto now = start;
+			do
+			{
+				slice->isDone = slice->task->Step();
+				now = Clock::now();
+			} while (!slice->isDone && now < end);
+
+			usedNanoseconds.fetch_add((uint64_t)chrono::duration_cast<chrono::nanoseconds>(now - start).count(), memory_order_relaxed);
+			if (enqueueTime)
+			{
+				profiler.Record({ slice->task->GetName(), enqueueTime, startTime, profiler.Now(),
+					profiler.GetCurrentFrame(), (uint8_t)JobPriority::Background, JobEventType::Job });
+			}
+		}, JobPriority::Background, &slicesCounter);
+	}
+}
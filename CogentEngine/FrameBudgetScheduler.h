@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include "ThreadPool.h"
+#include "JobCounter.h"
+
+using namespace std;
+
+// Long running work split into small steps, e.g. streaming, nav grid
+// rebuilds or baking. Step runs on a background worker and returns true
+// once the whole task is done, OnComplete then runs on the main thread.
+class ITimeSlicedTask
+{
+public:
+	virtual ~ITimeSlicedTask() = default;
+	virtual bool Step() = 0;
+	virtual void OnComplete() {}
+	virtual const char* GetName() { return "TimeSlicedTask"; }
+};
+
+struct FrameBudgetSettings
+{
+	double targetFrameMs = 1000.0 / 60.0;
+	// Background time handed out per frame, summed over all workers
+	double initialBudgetMs = 2.0;
+	double maxBudgetMs = 4.0;
+	// Below this the budget drops to zero and tasks are paused
+	double minBudgetMs = 0.25;
+	// Additive increase while there is headroom, multiplicative decrease when over target
+	double growMs = 0.25;
+	double shrinkFactor = 0.5;
+	// Weight of the newest frame in the smoothed frame time
+	double frameSmoothing = 0.1;
+};
+
+struct FrameBudgetStats
+{
+	double smoothedFrameMs = 0.0;
+	double budgetMs = 0.0;
+	double usedMs = 0.0;
+	// usedMs / budgetMs of the last dispatched frame
+	double utilisation = 0.0;
+	double averageUtilisation = 0.0;
+	uint64_t dispatchedFrames = 0;
+	uint64_t throttledFrames = 0;
+	uint64_t overrunFrames = 0;
+	uint64_t tasksCompleted = 0;
+	size_t activeTasks = 0;
+};
+
+// Hands background tasks a per-frame time budget on top of the ThreadPool.
+// The budget follows the measured frame time: it shrinks while frames are
+// over target, pauses tasks entirely when it falls below the minimum, and
+// grows back once there is headroom. All methods are main thread only.
+class FrameBudgetScheduler
+{
+public:
+	FrameBudgetScheduler(ThreadPool& pool, FrameBudgetSettings settings = {});
+	~FrameBudgetScheduler();
+
+	// The task is not owned and must stay alive until OnComplete or Remove
+	void Add(ITimeSlicedTask* task);
+	void Remove(ITimeSlicedTask* task);
+
+	// Call once a frame with the timer's delta time in seconds
+	void Update(float deltaTime);
+
+	FrameBudgetStats GetStats() const { return stats; }
+	size_t GetActiveTaskCount() const { return tasks.size() + addedTasks.size(); }
+
+private:
+	struct Entry
+	{
+		ITimeSlicedTask* task;
+		bool isDone;
+	};
+
+	void UpdateBudget(double frameMs);
+	void CollectSlices();
+	void Dispatch();
+
+	ThreadPool& pool;
+	FrameBudgetSettings settings;
+	FrameBudgetStats stats;
+	double budgetMs;
+	double utilisationSum = 0.0;
+
+	vector<Entry> tasks;
+	vector<ITimeSlicedTask*> addedTasks;
+	JobCounter slicesCounter;
+	atomic<uint64_t> usedNanoseconds{ 0 };
+	bool hasSlicesInFlight = false;
+};
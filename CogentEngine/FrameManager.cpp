@@ -161,19 +161,22 @@ void FrameManager::ResetFrameCounter()
 Entity* FrameManager::CreateEntity(Mesh* mesh, Material* material)
 {
 	ConstantBufferView cbv = CreateConstantBufferView(sizeof(VertexShaderExternalData));
-	Entity* entity;
-	entity = new Entity(mesh, gpuConstantBuffer, gpuHeap, constantBufferIndex, material, cbv);
+	EntityHandle handle = entityPool.Create(mesh, gpuConstantBuffer, gpuHeap, constantBufferIndex, material, cbv, &transformSystem);
 
-	return entity;
+	return entityPool.Get(handle);
 }
 
 Entity* FrameManager::CreateTransparentEntity(Mesh* mesh, Material* material)
 {
 	ConstantBufferView cbv = CreateConstantBufferView(sizeof(VertexShaderExternalData));
-	Entity* entity;
-	entity = new Entity(mesh, gpuConstantBuffer, gpuHeap, constantBufferIndex, material, cbv);
+	EntityHandle handle = entityPool.Create(mesh, gpuConstantBuffer, gpuHeap, constantBufferIndex, material, cbv, &transformSystem);
 
-	return entity;
+	return entityPool.Get(handle);
+}
+
+bool FrameManager::DestroyEntity(EntityHandle handle)
+{
+	return entityPool.Destroy(handle);
 }
 
 void FrameManager::CopyData(void* data, uint32_t size, ConstantBufferView cbv, uint32_t backBufferIndex)
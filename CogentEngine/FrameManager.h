@@ -5,6 +5,8 @@
 #include "ConstantBufferView.h"
 #include "DXUtility.h"
 #include "Entity.h"
+#include "EntityPool.h"
+#include "TransformSystem.h"
 #include "Material.h"
 #include "Texture.h"
 #include <map>
@@ -37,10 +39,18 @@ public:
 		bool isDepthTexture = false,
 		DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM);
 
+	// Entities are allocated from the entity pool and stay at the same
+	// address until destroyed. Null when the pool is full.
 	Entity* CreateEntity(Mesh* mesh, Material* material);
 	Entity* CreateTransparentEntity(Mesh* mesh, Material* material);
+	bool DestroyEntity(EntityHandle handle);
+	Entity* GetEntity(EntityHandle handle) const { return entityPool.Get(handle); }
+	EntityPool& GetEntityPool() { return entityPool; }
 	void CopyData(void* data, uint32_t size, ConstantBufferView cbv, uint32_t backBufferIndex);
 
+	// Transforms of every entity created above
+	TransformSystem& GetTransformSystem() { return transformSystem; }
+
 	D3D12_GPU_DESCRIPTOR_HANDLE GetGPUHandle(uint32_t index, uint32_t backBufferIndex);
 	D3D12_GPU_DESCRIPTOR_HANDLE Allocate(D3D12_CPU_DESCRIPTOR_HANDLE* handles, int num);
 	void ResetFrameCounter();
@@ -69,6 +79,9 @@ private:
 	std::map<std::string, Material> materialMap;
 	std::vector<std::string> materialID;
 	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> resources;
+	TransformSystem transformSystem;
+	// After the transform system, entities are destroyed first
+	EntityPool entityPool{ MAX_ENTITIES };
 
 	int count = 0;
 };
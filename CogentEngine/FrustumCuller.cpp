@@ -0,0 +1,232 @@
+#include "FrustumCuller.h"
+#include "Job.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#endif
+
+FrustumCuller::FrustumCuller(ThreadPool& pool)
+	: pool(pool)
+{
+	for (auto& plane : planes)
+	{
+		plane = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
+
+void FrustumCuller::SetFrustum(FXMMATRIX viewProjection)
+{
+	// Clip space is x, y in [-w, w] and z in [0, w]. With row vectors the
+	// planes are sums and differences of the matrix columns.
+	XMMATRIX columns = XMMatrixTranspose(viewProjection);
+	XMVECTOR extracted[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),		// left
+		XMVectorSubtract(columns.r[3], columns.r[0]),	// right
+		XMVectorAdd(columns.r[3], columns.r[1]),		// bottom
+		XMVectorSubtract(columns.r[3], columns.r[1]),	// top
+		columns.r[2],									// near
+		XMVectorSubtract(columns.r[3], columns.r[2]),	// far
+	};
+
+	for (int i = 0; i < 6; ++i)
+	{
+		XMStoreFloat4(&planes[i], XMPlaneNormalize(extracted[i]));
+	}
+}
+
+void FrustumCuller::BeginGather(size_t count)
+{
+	size_t paddedCount = (count + 3) & ~(size_t)3;
+	centerX.resize(paddedCount);
+	centerY.resize(paddedCount);
+	centerZ.resize(paddedCount);
+	extentX.resize(paddedCount);
+	extentY.resize(paddedCount);
+	extentZ.resize(paddedCount);
+	visibility.resize(paddedCount);
+
+	for (size_t i = count; i < paddedCount; ++i)
+	{
+		centerX[i] = centerY[i] = centerZ[i] = 0.0f;
+		extentX[i] = extentY[i] = extentZ[i] = 0.0f;
+	}
+}
+
+void FrustumCuller::SetGathered(size_t index, const BoundingBox& box)
+{
+	centerX[index] = box.Center.x;
+	centerY[index] = box.Center.y;
+	centerZ[index] = box.Center.z;
+	extentX[index] = box.Extents.x;
+	extentY[index] = box.Extents.y;
+	extentZ[index] = box.Extents.z;
+}
+
+void FrustumCuller::CullGathered()
+{
+	size_t paddedCount = centerX.size();
+	size_t batchCount = (paddedCount + FRUSTUM_CULL_BATCH_SIZE - 1) / FRUSTUM_CULL_BATCH_SIZE;
+	if (batchCount <= 1)
+	{
+		CullRange(0, paddedCount);
+		return;
+	}
+
+	while (jobs.size() < batchCount)
+	{
+		jobs.push_back(std::make_unique<FrustumCullJob>());
+	}
+
+	jobPointers.clear();
+	for (size_t b = 0; b < batchCount; ++b)
+	{
+		auto job = jobs[b].get();
+		job->culler = this;
+		job->first = b * FRUSTUM_CULL_BATCH_SIZE;
+		job->count = std::min((size_t)FRUSTUM_CULL_BATCH_SIZE, paddedCount - job->first);
+		jobPointers.push_back(job);
+	}
+
+	pool.EnqueueBatch(jobPointers, &jobsCounter, JobPriority::Critical);
+	pool.WaitForCounter(&jobsCounter);
+}
+
+void FrustumCuller::Cull(const std::vector<Entity*>& candidates, std::vector<Entity*>& visible)
+{
+	// Bounds may be recomputed on first access, so gather on this thread
+	BeginGather(candidates.size());
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		SetGathered(i, candidates[i]->GetWorldAABB());
+	}
+
+	CullGathered();
+
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		if (visibility[i])
+		{
+			visible.push_back(candidates[i]);
+			visibleCount++;
+		}
+	}
+
+	frameStats.tested += (uint32_t)candidates.size();
+	frameStats.visible += (uint32_t)visibleCount;
+}
+
+void FrustumCuller::CullSubmeshes(const std::vector<MeshEntry>& entries, const XMFLOAT4X4& worldTransposed, std::vector<uint8_t>& visible)
+{
+	XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&worldTransposed));
+	XMMATRIX absWorld;
+	for (int r = 0; r < 3; ++r)
+	{
+		absWorld.r[r] = XMVectorAbs(world.r[r]);
+	}
+
+	// World AABB of each mesh space box: the center is transformed, the
+	// extents go through the absolute rotation and scale
+	BeginGather(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const BoundingBox& local = entries[i].Bounds;
+		XMVECTOR extents = XMLoadFloat3(&local.Extents);
+		BoundingBox box;
+		XMStoreFloat3(&box.Center, XMVector3Transform(XMLoadFloat3(&local.Center), world));
+		XMStoreFloat3(&box.Extents, XMVectorAdd(XMVectorAdd(
+			XMVectorScale(absWorld.r[0], XMVectorGetX(extents)),
+			XMVectorScale(absWorld.r[1], XMVectorGetY(extents))),
+			XMVectorScale(absWorld.r[2], XMVectorGetZ(extents))));
+		SetGathered(i, box);
+	}
+
+	CullGathered();
+
+	visible.assign(visibility.begin(), visibility.begin() + entries.size());
+	size_t visibleCount = 0;
+	for (uint8_t flag : visible)
+	{
+		visibleCount += flag;
+	}
+
+	frameStats.submeshesTested += (uint32_t)entries.size();
+	frameStats.submeshesVisible += (uint32_t)visibleCount;
+}
+
+void FrustumCuller::CullRange(size_t first, size_t rangeCount)
+{
+	size_t last = first + rangeCount;
+#ifdef FRUSTUM_CULLER_SSE
+	// A box is outside once center distance + projected extent is negative
+	// for any plane. Lanes are boxes, planes are splatted.
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	__m128 absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; ++p)
+	{
+		planeX[p] = _mm_set1_ps(planes[p].x);
+		planeY[p] = _mm_set1_ps(planes[p].y);
+		planeZ[p] = _mm_set1_ps(planes[p].z);
+		planeW[p] = _mm_set1_ps(planes[p].w);
+		absX[p] = _mm_set1_ps(fabsf(planes[p].x));
+		absY[p] = _mm_set1_ps(fabsf(planes[p].y));
+		absZ[p] = _mm_set1_ps(fabsf(planes[p].z));
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	for (size_t i = first; i < last; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&extentX[i]);
+		__m128 ey = _mm_loadu_ps(&extentY[i]);
+		__m128 ez = _mm_loadu_ps(&extentZ[i]);
+
+		__m128 outside = zero;
+		for (int p = 0; p < 6; ++p)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+				_mm_mul_ps(absZ[p], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		visibility[i + 0] = (mask & 1) == 0;
+		visibility[i + 1] = (mask & 2) == 0;
+		visibility[i + 2] = (mask & 4) == 0;
+		visibility[i + 3] = (mask & 8) == 0;
+	}
+#else
+	for (size_t i = first; i < last; ++i)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; ++p)
+		{
+			const XMFLOAT4& plane = planes[p];
+			float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+			float radius = fabsf(plane.x) * extentX[i] + fabsf(plane.y) * extentY[i] + fabsf(plane.z) * extentZ[i];
+			inside = distance + radius >= 0.0f;
+		}
+		visibility[i] = inside;
+	}
+#endif
+}
+
+void FrustumCuller::BeginFrame()
+{
+	lastFrameStats = frameStats;
+	frameStats = FrustumCullStats();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "Constants.h"
+#include "Entity.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "JobCounter.h"
+
+using namespace DirectX;
+
+class FrustumCullJob;
+
+struct FrustumCullStats
+{
+	uint32_t tested = 0;
+	uint32_t visible = 0;
+	uint32_t submeshesTested = 0;
+	uint32_t submeshesVisible = 0;
+};
+
+// Tests entity and sub-mesh world AABBs against the six camera frustum planes. The boxes
+// are gathered into structure of arrays so SSE tests four boxes against a
+// plane at once, and the candidate list is split into jobs of
+// FRUSTUM_CULL_BATCH_SIZE boxes. Cull is main thread only.
+class FrustumCuller
+{
+public:
+	FrustumCuller(ThreadPool& pool);
+	~FrustumCuller();
+
+	// Planes from a row vector view * projection matrix, D3D clip space
+	void SetFrustum(FXMMATRIX viewProjection);
+
+	// Appends the candidates whose bounds touch the frustum to visible,
+	// keeping their order
+	void Cull(const std::vector<Entity*>& candidates, std::vector<Entity*>& visible);
+	// One flag per sub-mesh of a mesh drawn with the given transposed world matrix
+	void CullSubmeshes(const std::vector<MeshEntry>& entries, const XMFLOAT4X4& worldTransposed, std::vector<uint8_t>& visible);
+
+	// Tests the gathered boxes [first, first + rangeCount), first a multiple of 4.
+	// Ranges that don't overlap may run on different threads.
+	void CullRange(size_t first, size_t rangeCount);
+
+	// Latches the counts of all Cull calls since the last call
+	void BeginFrame();
+	const FrustumCullStats& GetLastFrameStats() const { return lastFrameStats; }
+
+private:
+	// Sizes the gathered arrays for count boxes plus padding
+	void BeginGather(size_t count);
+	void SetGathered(size_t index, const BoundingBox& box);
+	// Tests the gathered boxes, in jobs when there is more than one batch
+	void CullGathered();
+
+	// Normalized planes with the normal pointing inside: x, y, z, w = distance
+	XMFLOAT4 planes[6];
+
+	// Gathered AABBs, padded to a multiple of 4. Padding lanes are ignored.
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<uint8_t> visibility;
+
+	FrustumCullStats frameStats;
+	FrustumCullStats lastFrameStats;
+
+	ThreadPool& pool;
+	std::vector<std::unique_ptr<FrustumCullJob>> jobs;
+	std::vector<IJob*> jobPointers;
+	JobCounter jobsCounter;
+};
@@ -35,6 +35,14 @@ Game::~Game()
 	// Don't clean up until GPU is actually done
 	WaitForGPU();
 
+	// The pool is destroyed last, jobs still running on it would outlive the
+	// members they reference. Join every job the game has queued.
+	backgroundTasks.Remove(&navGridBake);
+	pathRequests.CancelAll();
+	pathRequests.WaitForSearches();
+	pool.WaitForCounter(&updateJobsCounter);
+	pool.WaitForCounter(&ioJobsCounter);
+
 	//delete meshes
 	delete sm_sphere;
 	delete sm_skyCube;
@@ -45,29 +53,9 @@ Game::~Game()
 	delete sm_buddhaStatue;
 	delete sm_quad;
 
-	//delete entities
-	delete e_plane;
-	delete e_buddhaStatue;
-	delete e_sponza;
-	delete ref_sphere;
-	delete e_sphereLight;
-	delete e_discLight;
-	delete e_rectLight;
+	// Entities are owned by the frame manager's entity pool
 	delete camera;
 
-	for (auto e : transparentEntities)
-	{
-		delete e.t_Entity;
-	}
-	if (!pbrEntities.empty())
-	{
-		for (auto e : pbrEntities)
-		{
-			delete e;
-		}
-	}
-	sphereAreaLightMap.clear();
-
 	rootSignature->Release();
 	toonShadingPipeState->Release();
 	outlinePipeState->Release();
@@ -88,6 +76,15 @@ void Game::Init()
 {
 	frameManager.Initialize(device.Get());
 	CreateLights();
+
+#if defined(DEBUG) || defined(_DEBUG)
+	auto& cpu = pool.GetCpuTopology();
+	printf("\nJob system: %zu workers (%zu physical / %zu logical cores)\n",
+		pool.GetNumberOfThreads(), cpu.physicalCores, cpu.logicalCores);
+	JobProfiler::Get().SetEnabled(true);
+	LockStats::SetEnabled(JOB_LOCK_STATS_LOG_FRAMES > 0);
+#endif
+
 	// Reset the command list to start
 	commandAllocator[currentBackBufferIndex]->Reset();
 	commandList->Reset(commandAllocator[currentBackBufferIndex], 0);
@@ -122,8 +119,10 @@ void Game::Init()
 	//entities[0]->SetPosition(XMFLOAT3(0, -4, 0));
 	//entities[0]->SetScale(XMFLOAT3(1, 1, 1));
 	//entities[0]->SetRotation(XMFLOAT3(-XM_PIDIV2, 0, 0));
-	currentIndex = 0;
+	// The reference sphere walks the path grid, clicking it and then the floor sends it there
+	pathAgent = world.Create(RenderableComponent{ ref_sphere }, AgentComponent{ pathAgentId, {}, 0, 2.0f, XMFLOAT3(2.0f, 3.0f, 10.0f) });
 	CreateNavmesh();
+	RegisterSystems();
 	//path = FindPath({ 0,0 }, { 16 , 16 });
 	frameManager.MarkBaseFrameHeapCounter();
 }
@@ -186,7 +185,7 @@ void Game::CreateMesh()
 	for (int i = 0; i < numEntities; ++i)
 	{
 		TransparentEntity entity;
-		entity.t_Entity = frameManager.CreateEntity(sm_sphere, &m_floor);
+		entity.t_Entity = frameManager.CreateEntity(sm_sphere, &m_default);
 		transparentEntities.push_back(entity);
 	}
 	e_plane = frameManager.CreateEntity(sm_plane, &m_plane);
@@ -197,23 +196,53 @@ void Game::CreateMesh()
 	for (int i = 0; i < pbrSphereCount; ++i)
 	{
 		Entity* e = frameManager.CreateEntity(sm_sphere, &pbrMaterials[i]);
-		pbrEntities.push_back(e);
+		pbrEntities.push_back(e->GetEntityHandle());
 	}
 	for (int i = pbrSphereCount; i < pbrCubeCount; ++i)
 	{
 		Entity* e = frameManager.CreateEntity(sm_cube, &pbrMaterials[i - pbrSphereCount]);
-		pbrEntities.push_back(e);
+		pbrEntities.push_back(e->GetEntityHandle());
 	}
 
 	// Area Light Entities
 	e_sphereLight = frameManager.CreateEntity(sm_sphere, &m_default);
-	sphereAreaLightMap[e_sphereLight] = sphereLight;
+	world.Create(RenderableComponent{ e_sphereLight }, AreaLightComponent{ AreaLightType::Sphere, &sphereLight, nullptr, nullptr });
 
 	e_discLight = frameManager.CreateEntity(sm_disc, &m_default);
-	discAreaLightMap[e_discLight] = &discLight;
+	world.Create(RenderableComponent{ e_discLight }, AreaLightComponent{ AreaLightType::Disc, nullptr, &discLight, nullptr });
 
 	e_rectLight = frameManager.CreateEntity(sm_quad, &m_default);
-	rectAreaLightMap[e_rectLight] = &rectLight;
+	world.Create(RenderableComponent{ e_rectLight }, AreaLightComponent{ AreaLightType::Rect, nullptr, nullptr, &rectLight });
+
+	for (auto& t : transparentEntities)
+	{
+		world.Create(RenderableComponent{ t.t_Entity }, TransparencyComponent{ 0.0f });
+	}
+
+	// Every entity above, in a fixed order, for the entity update stage
+	for (auto& t : transparentEntities)
+	{
+		entities.push_back(t.t_Entity->GetEntityHandle());
+	}
+	for (auto e : { e_plane, e_sponza, ref_sphere, e_buddhaStatue })
+	{
+		entities.push_back(e->GetEntityHandle());
+	}
+	entities.insert(entities.end(), pbrEntities.begin(), pbrEntities.end());
+	for (auto e : { e_sphereLight, e_discLight, e_rectLight })
+	{
+		entities.push_back(e->GetEntityHandle());
+	}
+	ResolveEntities(entities, resolvedEntities);
+	sceneBVH.SetEntities(resolvedEntities);
+	for (auto e : resolvedEntities)
+	{
+		spatialGrid.Insert(e);
+	}
+
+	pbrDrawEntities = pbrEntities;
+	pbrDrawEntities.push_back(e_sponza->GetEntityHandle());
+	toonDrawEntities = { e_plane->GetEntityHandle() };
 
 	CloseExecuteAndResetCommandList();
 }
@@ -436,7 +465,7 @@ D3D12_GRAPHICS_PIPELINE_STATE_DESC Game::CreatePSODescriptor(
 	return psoDesc;
 }
 
-void Game::DrawEntity(Entity* entity, XMFLOAT3 position)
+void Game::DrawEntity(Entity* entity)
 {
 	VertexShaderExternalData vertexData = {};
 	vertexData.world = entity->GetWorldMatrix();
@@ -458,8 +487,118 @@ void Game::DrawEntity(Entity* entity, XMFLOAT3 position)
 	commandList->SetGraphicsRootDescriptorTable(0, frameManager.GetGPUHandle(entity->GetConstantBufferView().heapIndex, currentBackBufferIndex));
 	commandList->SetGraphicsRootDescriptorTable(2, entity->GetMaterial()->GetGPUHandle());
 
-	DrawMesh(entity->GetMesh());
-	entity->SetPosition(position);
+	auto submeshes = submeshVisibility.find(entity->GetEntityHandle());
+	DrawMesh(entity->GetMesh(), submeshes != submeshVisibility.end() ? &submeshes->second : nullptr);
+}
+
+void Game::ResolveEntities(std::vector<EntityHandle>& handles, std::vector<Entity*>& resolved)
+{
+	resolved.clear();
+	size_t kept = 0;
+	for (auto handle : handles)
+	{
+		if (auto entity = frameManager.GetEntity(handle))
+		{
+			resolved.push_back(entity);
+			handles[kept++] = handle;
+		}
+		else
+		{
+			printf("Dropped stale entity handle %u:%u\n", handle.index, handle.generation);
+		}
+	}
+	handles.resize(kept);
+}
+
+void Game::CullEntities()
+{
+	auto viewMatrix = XMMatrixTranspose(XMLoadFloat4x4(&camera->GetViewMatrixTransposed()));
+	auto projMatrix = XMMatrixTranspose(XMLoadFloat4x4(&camera->GetProjectionMatrixTransposed()));
+	auto viewProjection = XMMatrixMultiply(viewMatrix, projMatrix);
+	frustumCuller.SetFrustum(viewProjection);
+
+	auto cull = [this](std::vector<EntityHandle>& candidates, std::vector<EntityHandle>& visible)
+	{
+		ResolveEntities(candidates, resolvedEntities);
+		culledEntities.clear();
+		frustumCuller.Cull(resolvedEntities, culledEntities);
+		visible.clear();
+		for (auto e : culledEntities)
+		{
+			visible.push_back(e->GetEntityHandle());
+		}
+	};
+	cull(pbrDrawEntities, visiblePbrEntities);
+	cull(toonDrawEntities, visibleToonEntities);
+
+	// Large models like Sponza are mostly off screen even when visible
+	for (auto handle : visiblePbrEntities)
+	{
+		auto e = frameManager.GetEntity(handle);
+		auto& entries = e->GetMesh()->MeshEntries;
+		if (entries.size() > 1)
+		{
+			frustumCuller.CullSubmeshes(entries, e->GetWorldMatrix(), submeshVisibility[handle]);
+		}
+	}
+
+	CullOccluded(viewProjection);
+}
+
+void Game::CullOccluded(FXMMATRIX viewProjection)
+{
+	occlusionBuffer.BeginScene(viewProjection);
+	if (std::find(visiblePbrEntities.begin(), visiblePbrEntities.end(), e_sponza->GetEntityHandle()) != visiblePbrEntities.end())
+	{
+		occlusionBuffer.AddOccluder(&sponza.Occluder, e_sponza->GetWorldMatrix());
+	}
+	occlusionBuffer.Rasterize();
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+	occlusionBoxes.clear();
+	for (auto handle : visiblePbrEntities)
+	{
+		occlusionBoxes.push_back(frameManager.GetEntity(handle)->GetWorldAABB());
+	}
+	occlusionBuffer.TestBoxes(occlusionBoxes, identity, occlusionVisibility);
+	size_t kept = 0;
+	for (size_t i = 0; i < visiblePbrEntities.size(); ++i)
+	{
+		if (occlusionVisibility[i])
+		{
+			visiblePbrEntities[kept++] = visiblePbrEntities[i];
+		}
+	}
+	visiblePbrEntities.resize(kept);
+
+	// Sub-meshes that passed the frustum test, in their mesh space
+	for (auto handle : visiblePbrEntities)
+	{
+		auto submeshes = submeshVisibility.find(handle);
+		if (submeshes == submeshVisibility.end())
+			continue;
+
+		auto e = frameManager.GetEntity(handle);
+		auto& entries = e->GetMesh()->MeshEntries;
+		auto& flags = submeshes->second;
+		occlusionBoxes.clear();
+		occlusionSubmeshes.clear();
+		for (uint32_t i = 0; i < flags.size(); ++i)
+		{
+			if (flags[i])
+			{
+				occlusionBoxes.push_back(entries[i].Bounds);
+				occlusionSubmeshes.push_back(i);
+			}
+		}
+
+		occlusionBuffer.TestBoxes(occlusionBoxes, e->GetWorldMatrix(), occlusionVisibility);
+		for (size_t i = 0; i < occlusionSubmeshes.size(); ++i)
+		{
+			flags[occlusionSubmeshes[i]] = occlusionVisibility[i];
+		}
+	}
 }
 
 void Game::DrawTransparentEntity(Entity* entity, float blendAmount)
@@ -578,6 +717,35 @@ void Game::Update(float deltaTime, float totalTime)
 
 	camera->Update(deltaTime);
 
+	pool.BeginFrame(++frameIndex);
+	frameManager.GetTransformSystem().BeginFrame();
+	frustumCuller.BeginFrame();
+
+	// Dump the job timeline of the last few frames for chrome://tracing
+	bool traceKeyDown = GetAsyncKeyState(VK_F9) != 0;
+	if (traceKeyDown && !bTraceKeyDown && JobProfiler::Get().IsEnabled())
+	{
+		auto firstFrame = frameIndex > JOB_TRACE_FRAME_COUNT ? frameIndex - JOB_TRACE_FRAME_COUNT : 0;
+		JobProfiler::Get().WriteChromeTrace("JobTrace.json", firstFrame, frameIndex);
+	}
+	bTraceKeyDown = traceKeyDown;
+
+	if (LockStats::IsEnabled() && frameIndex % JOB_LOCK_STATS_LOG_FRAMES == 0)
+	{
+		printf("\nJob system locks, last %u frames\n", JOB_LOCK_STATS_LOG_FRAMES);
+		LockStats::Print(pool.GetLockStats());
+		pool.ResetLockStats();
+		printf("Transforms recomputed last frame: %u\n", frameManager.GetTransformSystem().GetLastFrameRecomputeCount());
+		auto& cullStats = frustumCuller.GetLastFrameStats();
+		printf("Frustum culling last frame: %u of %u visible, %u of %u sub-meshes\n",
+			cullStats.visible, cullStats.tested, cullStats.submeshesVisible, cullStats.submeshesTested);
+		auto& occlusionStats = occlusionBuffer.GetStats();
+		printf("Occlusion culling last frame: %u of %u hidden, %u of %u occluder triangles rasterized\n",
+			occlusionStats.occluded, occlusionStats.tested, occlusionStats.rasterizedTriangles, occlusionStats.occluderTriangles);
+		printf("Spatial hash: %zu entities in %zu cells, %u changed cell last frame\n",
+			spatialGrid.GetCount(), spatialGrid.GetCellCount(), spatialGrid.GetLastUpdateMoveCount());
+	}
+
 	if (GetAsyncKeyState(VK_TAB))
 	{
 		sgbDoubleBounce = true;
@@ -595,119 +763,219 @@ void Game::Update(float deltaTime, float totalTime)
 		bBlurEnabled = false;
 	}
 
-	// Scale-->Rotation-->Transform
-	// For reference, to place object in front of camera start with position: (-8.0f, 1.0f, 12.0f)
+	// Animation, world matrices and bounds of every entity in parallel batches.
+	// Systems below read the animated positions.
+	ResolveEntities(entities, resolvedEntities);
+	entityUpdateStage.Run(resolvedEntities, [this, totalTime](Entity* entity, size_t)
+	{
+		AnimateEntity(entity, totalTime);
+	});
 
-	transparentEntities[0].t_Entity->SetPosition(XMFLOAT3(0.0f, 3.0f, 10.0f));
-	transparentEntities[0].t_Entity->SetMaterial(&m_default);
+	// MyJob blocks like a file read would, keep it off the workers
+	if (job1.IsCompleted())
+		pool.Enqueue(&job1, &ioJobsCounter, JobPriority::IO);
 
-	transparentEntities[1].t_Entity->SetPosition(XMFLOAT3(-3.0f, 3.0f, 10.0f));
-	transparentEntities[1].t_Entity->SetMaterial(&m_default);
+	// Per-frame update jobs are fenced by a counter and joined below
+	job2.totalTime = totalTime;
+	pool.Enqueue(&job2, &updateJobsCounter, JobPriority::Critical);
 
-	ref_sphere->SetPosition(XMFLOAT3(-5.0f, 3.0f, 10.0f));
+	// Superseded searches are dropped by the queue, only the latest path arrives
+	pathRequests.CollectFinished();
+	auto agent = world.Get<AgentComponent>(pathAgent);
+	if (agent && pathRequests.TryTakePath(agent->agentId, agent->path))
+	{
+		// findPath lists the target first, agents walk from the front
+		std::reverse(agent->path.begin(), agent->path.end());
+		agent->currentIndex = 0;
+	}
 
-	e_plane->SetScale(XMFLOAT3(0.7f, 0.7f, 0.7f));
-	e_plane->SetRotation(XMFLOAT3(-90.0f, -90.0f, 0.0f));
-	e_plane->SetPosition(XMFLOAT3(-2.8f, 2.0f, 2.0f));
-	e_plane->SetMaterial(&m_plane);
+	// Area lights, transparency depth and agents, in parallel where their components allow
+	systemDeltaTime = deltaTime;
+	systems.Run();
 
-	e_buddhaStatue->SetScale(XMFLOAT3(5.f, 5.f, 5.f));
-	e_buddhaStatue->SetRotation(XMFLOAT3(0.0f, -120.0f, 0.0f));
-	e_buddhaStatue->SetPosition(XMFLOAT3(-10.0f, 2.0f, 20.0f));
+	// Agents move in their component, their entities follow here on the main
+	// thread. Their world matrices are refreshed on first access.
+	world.ForEach<RenderableComponent, AgentComponent>([](RenderableComponent& renderable, AgentComponent& agent)
+	{
+		renderable.entity->SetPosition(agent.position);
+	});
 
-	e_sponza->SetScale(XMFLOAT3(0.02f, 0.02f, 0.02f));
-	e_sponza->SetPosition(XMFLOAT3(0, 0.0f, 10.0f));
+	sceneBVH.Update();
+	spatialGrid.Update();
+	CullEntities();
 
-	for (int i = 0; i < pbrEntities.size(); ++i)
+	// The PBR spheres and cubes stand on the path grid, bake their footprints once
+	// their bounds are known. The walls arrive a few frames later.
+	if (!isNavGridQueued)
 	{
-		pbrEntities[i]->SetScale(XMFLOAT3(2.0f, 2.0f, 2.0f));
-		pbrEntities[i]->SetPosition(XMFLOAT3(-8.0f + float(i * 3), 1.0f, 13.0f));
+		std::vector<BoundingBox> obstacles;
+		ResolveEntities(pbrEntities, resolvedEntities);
+		for (auto entity : resolvedEntities)
+		{
+			obstacles.push_back(entity->GetWorldAABB());
+		}
+		navGridBake.Reset({ NAV_GRID_SIZE, NAV_GRID_SIZE }, std::move(obstacles));
+		backgroundTasks.Add(&navGridBake);
+		isNavGridQueued = true;
 	}
 
-	e_sphereLight->SetPosition(XMFLOAT3(5 + sin(totalTime) * 5, 1, 10));
-
-	e_discLight->SetScale(XMFLOAT3(0.01f, 0.01f, 0.01f));
-	e_discLight->SetRotation(XMFLOAT3(0.0f, 90.0f, 30.0f));
-	e_discLight->SetPosition(XMFLOAT3(-5, sin(totalTime * 3) + 2, 8));
+	// Join the update jobs, the main thread helps with pending jobs meanwhile
+	pool.WaitForCounter(&updateJobsCounter);
 
-	e_rectLight->SetScale(XMFLOAT3(5, 1, 5));
-	e_rectLight->SetRotation(XMFLOAT3(0, 0, 90));
-	e_rectLight->SetPosition(XMFLOAT3(18, 2 + sin(totalTime * 3), 11));
+	// Hand out this frame's budget to streaming/baking style tasks
+	backgroundTasks.Update(deltaTime);
 
-	if (job1.IsCompleted())
-		auto f1 = pool.Enqueue(&job1);
+	//for the callback functions
+	pool.ExecuteCallbacks(JOB_CALLBACK_BUDGET_MS);
 
+	// Back to front for blending
+	depthSortedEntities.clear();
+	world.ForEach<RenderableComponent, TransparencyComponent>([this](RenderableComponent& renderable, TransparencyComponent& transparency)
+	{
+		depthSortedEntities.push_back({ renderable.entity, transparency.linearDepth });
+	});
+	std::sort(depthSortedEntities.begin(), depthSortedEntities.end(), CompareByLength);
+}
 
-	if (job2.IsCompleted())
+// Runs in the entity update stage's jobs, only touches the entity it is given.
+// The path agent's sphere is moved by its AgentComponent instead.
+void Game::AnimateEntity(Entity* entity, float totalTime)
+{
+	// Scale-->Rotation-->Transform
+	// For reference, to place object in front of camera start with position: (-8.0f, 1.0f, 12.0f)
+	auto pbrEntity = std::find(pbrEntities.begin(), pbrEntities.end(), entity->GetEntityHandle());
+	if (pbrEntity != pbrEntities.end())
 	{
-		job2.totalTime = totalTime;
-		auto f2 = pool.Enqueue(&job2);
+		entity->SetScale(XMFLOAT3(2.0f, 2.0f, 2.0f));
+		entity->SetPosition(XMFLOAT3(-8.0f + float((pbrEntity - pbrEntities.begin()) * 3), 1.0f, 13.0f));
 	}
-
-	if (pathFinderJob.IsCompleted())
+	else if (entity == transparentEntities[0].t_Entity)
 	{
-		path = pathFinderJob.path;
+		entity->SetPosition(XMFLOAT3(0.0f, 3.0f, 10.0f));
 	}
-
-	//for the callback functions
-	pool.ExecuteCallbacks();
-
-	// Get Linear Z of all transparent entities
-	for (auto& t : transparentEntities)
+	else if (entity == transparentEntities[1].t_Entity)
 	{
-		t.zPosition = ComputeZDistance(camera, t.t_Entity->GetPosition());
+		entity->SetPosition(XMFLOAT3(-3.0f, 3.0f, 10.0f));
+	}
+	else if (entity == e_plane)
+	{
+		entity->SetScale(XMFLOAT3(0.7f, 0.7f, 0.7f));
+		entity->SetRotation(XMFLOAT3(-90.0f, -90.0f, 0.0f));
+		entity->SetPosition(XMFLOAT3(-2.8f, 2.0f, 2.0f));
+	}
+	else if (entity == e_buddhaStatue)
+	{
+		entity->SetScale(XMFLOAT3(5.f, 5.f, 5.f));
+		entity->SetRotation(XMFLOAT3(0.0f, -120.0f, 0.0f));
+		entity->SetPosition(XMFLOAT3(-10.0f, 2.0f, 20.0f));
+	}
+	else if (entity == e_sponza)
+	{
+		entity->SetScale(XMFLOAT3(0.02f, 0.02f, 0.02f));
+		entity->SetPosition(XMFLOAT3(0, 0.0f, 10.0f));
+	}
+	else if (entity == e_sphereLight)
+	{
+		entity->SetPosition(XMFLOAT3(5 + sin(totalTime) * 5, 1, 10));
+	}
+	else if (entity == e_discLight)
+	{
+		entity->SetScale(XMFLOAT3(0.01f, 0.01f, 0.01f));
+		entity->SetRotation(XMFLOAT3(0.0f, 90.0f, 30.0f));
+		entity->SetPosition(XMFLOAT3(-5, sin(totalTime * 3) + 2, 8));
+	}
+	else if (entity == e_rectLight)
+	{
+		entity->SetScale(XMFLOAT3(5, 1, 5));
+		entity->SetRotation(XMFLOAT3(0, 0, 90));
+		entity->SetPosition(XMFLOAT3(18, 2 + sin(totalTime * 3), 11));
 	}
-
-	UpdateAreaLights();
-
-	// Sort the vector
-	std::sort(transparentEntities.begin(), transparentEntities.end(), CompareByLength);
 }
 
-void Game::UpdateAreaLights()
+// Systems only read entity transforms, which are set before systems.Run
+void Game::RegisterSystems()
 {
-	// Order: Scale -- Rotation -- Position
-	sphereLight.LightPos = e_sphereLight->GetPosition();
-	discLight.LightPos = e_discLight->GetPosition();
-	UpdateDiscLightDirection(e_discLight);
-	UpdateRectLights(e_rectLight);
+	systems.AddSystem("AreaLights",
+		EcsWorld::MaskOf<RenderableComponent>(),
+		EcsWorld::MaskOf<AreaLightComponent>(),
+		[this](EcsWorld& world)
+	{
+		// Order: Scale -- Rotation -- Position
+		world.ForEach<RenderableComponent, AreaLightComponent>([this](RenderableComponent& renderable, AreaLightComponent& light)
+		{
+			switch (light.type)
+			{
+			case AreaLightType::Sphere:
+				light.sphere->LightPos = renderable.entity->GetPosition();
+				break;
+			case AreaLightType::Disc:
+				light.disc->LightPos = renderable.entity->GetPosition();
+				UpdateDiscLightDirection(renderable.entity, light.disc);
+				break;
+			case AreaLightType::Rect:
+				UpdateRectLights(renderable.entity, light.rect);
+				break;
+			}
+		});
+	});
+
+	systems.AddSystem("TransparencyDepth",
+		EcsWorld::MaskOf<RenderableComponent>(),
+		EcsWorld::MaskOf<TransparencyComponent>(),
+		[this](EcsWorld& world)
+	{
+		world.ForEach<RenderableComponent, TransparencyComponent>([this](RenderableComponent& renderable, TransparencyComponent& transparency)
+		{
+			transparency.linearDepth = ComputeZDistance(camera, renderable.entity->GetPosition());
+		});
+	});
+
+	// Walks the agent along its grid path, x and y of a path node are world x and z
+	systems.AddSystem("PathAgents",
+		0,
+		EcsWorld::MaskOf<AgentComponent>(),
+		[this](EcsWorld& world)
+	{
+		world.ForEach<AgentComponent>([this](AgentComponent& agent)
+		{
+			if (agent.currentIndex >= (int)agent.path.size())
+				return;
+
+			auto& node = agent.path[agent.currentIndex];
+			XMVECTOR target = XMVectorSet((float)node.x, agent.position.y, (float)node.y, 0.0f);
+			XMVECTOR position = MoveTowards(XMLoadFloat3(&agent.position), target, agent.speed * systemDeltaTime, agent.currentIndex);
+			XMStoreFloat3(&agent.position, position);
+		});
+	});
 }
 
-void Game::UpdateDiscLightDirection(Entity* areaLightEntity)
+void Game::UpdateDiscLightDirection(Entity* areaLightEntity, DiscAreaLight* light)
 {
-	auto &it = discAreaLightMap.find(areaLightEntity);
-	if (it != discAreaLightMap.end())
-	{
-		auto rotation = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&areaLightEntity->GetRotation()));
-		auto lightDirection = XMFLOAT3(0, 0, 0);
-		auto direction = XMVectorSet(-1.f, 0.f, 0.f, 0.f);
-		direction = XMVector3Rotate(direction, rotation);
-		XMStoreFloat3(&lightDirection, direction);
-		it->second->PlaneNormal = lightDirection;
-	}
+	auto rotation = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&areaLightEntity->GetRotation()));
+	auto lightDirection = XMFLOAT3(0, 0, 0);
+	auto direction = XMVectorSet(-1.f, 0.f, 0.f, 0.f);
+	direction = XMVector3Rotate(direction, rotation);
+	XMStoreFloat3(&lightDirection, direction);
+	light->PlaneNormal = lightDirection;
 }
 
-void Game::UpdateRectLights(Entity* areaLightEntity)
+void Game::UpdateRectLights(Entity* areaLightEntity, RectAreaLight* light)
 {
 	auto defaultUpVector = XMFLOAT3(0, 1, 0);
-	auto &it = rectAreaLightMap.find(areaLightEntity);
-	if (it != rectAreaLightMap.end())
-	{
-		it->second->LightPos = areaLightEntity->GetPosition();
-		it->second->LightUp = defaultUpVector; // default up vector
-		auto rotation = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&areaLightEntity->GetRotation()));
-		auto lightDirection = XMFLOAT3(0, 0, 0);
-		auto direction = XMVectorSet(-1.f, 5.9f, 0.f, 0.f);
-		direction = XMVector3Rotate(direction, rotation);
-
-		XMStoreFloat3(&lightDirection, direction);
-		//auto leftVector = gameUtil.CalculateLeftVector(defaultUpVector, lightDirection);
-
-		//it->second->PlaneNormal = lightDirection;
-		it->second->LightLeft = XMFLOAT3(0,0,-1);
-		it->second->LightWidth = areaLightEntity->GetScale().x;
-		it->second->LightHeight = areaLightEntity->GetScale().z;
-	}
+	light->LightPos = areaLightEntity->GetPosition();
+	light->LightUp = defaultUpVector; // default up vector
+	auto rotation = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&areaLightEntity->GetRotation()));
+	auto lightDirection = XMFLOAT3(0, 0, 0);
+	auto direction = XMVectorSet(-1.f, 5.9f, 0.f, 0.f);
+	direction = XMVector3Rotate(direction, rotation);
+
+	XMStoreFloat3(&lightDirection, direction);
+	//auto leftVector = gameUtil.CalculateLeftVector(defaultUpVector, lightDirection);
+
+	//light->PlaneNormal = lightDirection;
+	light->LightLeft = XMFLOAT3(0,0,-1);
+	light->LightWidth = areaLightEntity->GetScale().x;
+	light->LightHeight = areaLightEntity->GetScale().z;
 }
 
 /// <summary>
@@ -806,9 +1074,7 @@ void Game::Draw(float deltaTime, float totalTime)
 			frameManager.GetGPUHandle(pixelCBV.heapIndex, currentBackBufferIndex));
 
 		// Area Lights
-		DrawAreaLights(e_sphereLight, AreaLightType::Sphere);
-		DrawAreaLights(e_discLight, AreaLightType::Disc);
-		DrawAreaLights(e_rectLight, AreaLightType::Rect);
+		DrawAreaLights();
 
 		// Image Based Lighting
 		commandList->SetGraphicsRootDescriptorTable(
@@ -816,14 +1082,16 @@ void Game::Draw(float deltaTime, float totalTime)
 			skyIrradiance.GetGPUHandle());
 
 		commandList->SetPipelineState(pbrPipeState);
-		for (auto e : pbrEntities)
+		for (auto handle : visiblePbrEntities)
 		{
-			DrawEntity(e);
+			DrawEntity(frameManager.GetEntity(handle));
 		}
-		DrawEntity(e_sponza);
 
 		commandList->SetPipelineState(toonShadingPipeState);
-		DrawEntity(e_plane);
+		for (auto handle : visibleToonEntities)
+		{
+			DrawEntity(frameManager.GetEntity(handle));
+		}
 
 		DrawSky();
 
@@ -854,7 +1122,7 @@ void Game::Draw(float deltaTime, float totalTime)
 	}
 }
 
-void Game::DrawMesh(Mesh* mesh)
+void Game::DrawMesh(Mesh* mesh, const std::vector<uint8_t>* submeshVisibility)
 {
 	commandList->IASetVertexBuffers(0, 1, &mesh->GetVertexBufferView());
 	commandList->IASetIndexBuffer(&mesh->GetIndexBufferView());
@@ -864,6 +1132,12 @@ void Game::DrawMesh(Mesh* mesh)
 	{
 		for (auto m : mesh->MeshEntries)
 		{
+			if (submeshVisibility && !(*submeshVisibility)[i])
+			{
+				i++;
+				continue;
+			}
+
 			auto mat = sponzaMat[i];
 			//commandList->SetGraphicsRootDescriptorTable(0, frameManager.GetGPUHandle(mat.materialIndex, currentBackBufferIndex));
 			commandList->SetGraphicsRootDescriptorTable(2, mat.GetGPUHandle());
@@ -1110,37 +1384,20 @@ void Game::DrawTransparentEntities()
 		frameManager.GetGPUHandle(transparencyCBV.heapIndex, currentBackBufferIndex));
 	commandList->SetPipelineState(transparencyPipeState);
 
-	for (auto transparentEntity : transparentEntities)
+	for (auto transparentEntity : depthSortedEntities)
 	{
 		DrawTransparentEntity(transparentEntity.t_Entity, 0.05f);
 	}
 }
 
-void Game::DrawAreaLights(Entity* entity, AreaLightType type)
+void Game::DrawAreaLights()
 {
 	commandList->SetPipelineState(areaLightEntityPipeState);
 
-	if (type == AreaLightType::Sphere)
+	world.ForEach<RenderableComponent, AreaLightComponent>([this](RenderableComponent& renderable, AreaLightComponent&)
 	{
-		auto it = sphereAreaLightMap.find(entity);
-		if (it != sphereAreaLightMap.end())
-		{
-			DrawEntity(entity);
-		}
-	}
-	if (type == AreaLightType::Disc)
-	{
-		auto it = discAreaLightMap.find(entity);
-		if (it != discAreaLightMap.end())
-		{
-			DrawEntity(entity);
-		}
-	}
-	if (type == AreaLightType::Rect)
-	{
-		DrawEntity(e_rectLight, XMFLOAT3(-10.0f, 2.0f, 5.0f));
-	}
-	
+		DrawEntity(renderable.entity);
+	});
 }
 
 
@@ -1173,9 +1430,30 @@ bool Game::CompareByLength(const TransparentEntity& a, const TransparentEntity&
 	return a.zPosition > b.zPosition;
 }
 
+ThreadPoolSettings Game::GetJobSystemSettings()
+{
+	ThreadPoolSettings settings;
+	settings.numberOfThreads = JOB_WORKER_COUNT;
+	settings.numberOfIOThreads = JOB_IO_THREAD_COUNT;
+	settings.pinWorkers = JOB_PIN_WORKERS;
+	settings.spinCount = JOB_SPIN_COUNT;
+	settings.yieldCount = JOB_YIELD_COUNT;
+	settings.threadName = "Job Worker";
+	return settings;
+}
+
+FrameBudgetSettings Game::GetBackgroundBudgetSettings()
+{
+	FrameBudgetSettings settings;
+	settings.targetFrameMs = JOB_TARGET_FRAME_MS;
+	settings.initialBudgetMs = JOB_BACKGROUND_BUDGET_MS;
+	settings.maxBudgetMs = JOB_BACKGROUND_MAX_BUDGET_MS;
+	return settings;
+}
+
 void Game::CreateNavmesh()
 {
-	generator.setWorldSize({ 20, 20 });
+	generator.setWorldSize({ NAV_GRID_SIZE, NAV_GRID_SIZE });
 	generator.setHeuristic(AStar::Heuristic::manhattan);
 	generator.setDiagonalMovement(true);
 	AddCollider(generator, { 14, 13 });
@@ -1190,7 +1468,7 @@ AStar::CoordinateList Game::FindPath(AStar::Vec2i source, AStar::Vec2i target)
 	return path;
 }
 
-XMVECTOR Game::MoveTowards(XMVECTOR current, XMVECTOR target, float distanceDelta)
+XMVECTOR Game::MoveTowards(XMVECTOR current, XMVECTOR target, float distanceDelta, int& pathIndex)
 {
 	XMVECTOR diff = XMVectorSubtract(target, current);
 	XMVECTOR length = XMVector3Length(diff);
@@ -1200,7 +1478,7 @@ XMVECTOR Game::MoveTowards(XMVECTOR current, XMVECTOR target, float distanceDelt
 
 	if (currentDist <= distanceDelta || currentDist == 0)
 	{
-		currentIndex++;
+		pathIndex++;
 		return target;
 
 	}
@@ -1225,6 +1503,20 @@ void Game::AddCollider(AStar::Generator& generator, AStar::Vec2i coordinates)
 
 }
 
+void Game::GetPickingRay(Camera* camera, int mouseX, int mouseY, XMVECTOR& origin, XMVECTOR& direction)
+{
+	auto viewMatrix = XMMatrixTranspose(XMLoadFloat4x4(&camera->GetViewMatrixTransposed()));
+	auto projMatrix = XMMatrixTranspose(XMLoadFloat4x4(&camera->GetProjectionMatrixTransposed()));
+
+	origin = XMVector3Unproject(XMVectorSet((float)mouseX, (float)mouseY, 0.f, 0.f),
+		0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 1,
+		projMatrix, viewMatrix, XMMatrixIdentity());
+	auto dest = XMVector3Unproject(XMVectorSet((float)mouseX, (float)mouseY, 1.f, 0.f),
+		0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0, 1,
+		projMatrix, viewMatrix, XMMatrixIdentity());
+	direction = XMVector3Normalize(dest - origin);
+}
+
 bool Game::IsIntersecting(Entity* entity, Camera* camera, int mouseX, int mouseY, float& distance)
 {
 	newDestination = XMFLOAT3(0, 0, 0);
@@ -1359,34 +1651,55 @@ void Game::OnMouseDown(WPARAM buttonState, int x, int y)
 	SetCapture(hWnd);
 	float distance = 0.0f;
 
-	//if (IsIntersecting(entities[3], camera, x, y, distance) && isSelected)
-	//{
-	//	currentIndex = 0;
-	//	pathFinderJob.currentPos = entities[selectedEntityIndex]->GetPosition();
-	//	pathFinderJob.targetPos = newDestination;
-	//	pathFinderJob.generator = &generator;
-	//	auto f2 = pool.Enqueue(&pathFinderJob);
-	//	isSelected = false;
-	//}
-
-
-	//for (int i = 0; i < entities.size(); ++i)
-	//{
-	//	if (IsIntersecting(entities[i], camera, x, y, distance) && i != 3)
-	//	{
-	//		selectedEntityIndex = i;
-	//		isSelected = true;
-	//		printf("Intersecting %d\n", i);
-	//		printf("Selected Entity %d\n", selectedEntityIndex);
-	//		break;
-	//	}
-	//	else if(i != 3)
-	//	{
-	//		//selectedEntityIndex = -1;
-	//		printf("Unselect Entity \n");
-	//		isSelected = false;
-	//	}
-	//}
+	XMVECTOR rayOrigin, rayDirection;
+	GetPickingRay(camera, x, y, rayOrigin, rayDirection);
+
+	// With the path agent picked, a click on the floor inside the grid sends it there
+	auto agent = world.Get<AgentComponent>(pathAgent);
+	auto agentRenderable = world.Get<RenderableComponent>(pathAgent);
+	if (agent && agentRenderable && pickedEntity == agentRenderable->entity->GetEntityHandle() && IntersectsFloor(rayOrigin, rayDirection, newDestination))
+	{
+		if (newDestination.x >= 0.0f && newDestination.x < NAV_GRID_SIZE && newDestination.z >= 0.0f && newDestination.z < NAV_GRID_SIZE)
+		{
+			pathRequests.Request(agent->agentId, agent->position, newDestination);
+			pickedEntity = EntityHandle();
+			isSelected = false;
+			return;
+		}
+	}
+
+	// Nearest hit through the scene BVH instead of testing every entity
+	auto picked = sceneBVH.RayCast(rayOrigin, rayDirection, distance);
+	pickedEntity = picked ? picked->GetEntityHandle() : EntityHandle();
+	isSelected = picked != nullptr;
+	if (picked)
+	{
+		printf("Selected Entity %u at %.2f\n", pickedEntity.index, distance);
+
+		// The picked entity is usually in the results too, it is filtered out
+		auto pickedWorld = picked->GetWorldMatrix();
+		XMFLOAT3 position(pickedWorld._14, pickedWorld._24, pickedWorld._34);
+		resolvedEntities.clear();
+		spatialGrid.QueryRadius(position, SPATIAL_HASH_CELL_SIZE, resolvedEntities);
+		pickedNeighbours.clear();
+		for (auto e : resolvedEntities)
+		{
+			if (e != picked)
+			{
+				pickedNeighbours.push_back(e->GetEntityHandle());
+			}
+		}
+		printf("%zu entities within %.1f\n", pickedNeighbours.size(), SPATIAL_HASH_CELL_SIZE);
+
+		// Nearest first, one more than needed in case the picked entity is among them
+		resolvedEntities.clear();
+		spatialGrid.QueryNearest(position, 2, resolvedEntities);
+		auto nearest = std::find_if(resolvedEntities.begin(), resolvedEntities.end(), [picked](Entity* e) { return e != picked; });
+		if (nearest != resolvedEntities.end())
+		{
+			printf("Nearest entity %u\n", (*nearest)->GetEntityHandle().index);
+		}
+	}
 }
 
 
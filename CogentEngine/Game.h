@@ -20,6 +20,18 @@
 #include "ThreadPool.h"
 #include "IJob.h"
 #include "Job.h"
+#include "PathRequestQueue.h"
+#include "NavGridBakeTask.h"
+#include "FrameBudgetScheduler.h"
+#include "EntityUpdateStage.h"
+#include "EcsWorld.h"
+#include "SystemScheduler.h"
+#include "Components.h"
+#include "SceneBVH.h"
+#include "RayPick.h"
+#include "FrustumCuller.h"
+#include "OcclusionBuffer.h"
+#include "SpatialHashGrid.h"
 
 #include "d3dx12.h"
 #include "ConstantBuffer.h"
@@ -51,17 +63,19 @@ public:
 	~Game();
 
 	int numEntities = 2;
-	int currentIndex;
 	int textureCount = 3;
 
-	AStar::CoordinateList path;
 
 	void Init();
 	void OnResize();
 	void Update(float deltaTime, float totalTime);
-	void UpdateAreaLights();
-	void UpdateDiscLightDirection(Entity* areaLightEntity);
-	void UpdateRectLights(Entity* areaLightEntity);
+	// ECS systems, registered once in Init
+	void RegisterSystems();
+	void UpdateDiscLightDirection(Entity* areaLightEntity, DiscAreaLight* light);
+	void UpdateRectLights(Entity* areaLightEntity, RectAreaLight* light);
+	void AnimateEntity(Entity* entity, float totalTime);
+	// Live entities of handles in order, stale handles are dropped from handles
+	void ResolveEntities(std::vector<EntityHandle>& handles, std::vector<Entity*>& resolved);
 
 	// Create and Load
 	void CreateMaterials();
@@ -72,15 +86,20 @@ public:
 
 	// Drawing 
 	void Draw(float deltaTime, float totalTime);
-	void DrawMesh(Mesh* mesh);
-	void DrawEntity(Entity* entity, XMFLOAT3 position = XMFLOAT3(0, 0, 0));
+	// Sub-meshes flagged 0 in submeshVisibility are skipped
+	void DrawMesh(Mesh* mesh, const std::vector<uint8_t>* submeshVisibility = nullptr);
+	void DrawEntity(Entity* entity);
+	// Fills the visible lists the opaque passes draw from
+	void CullEntities();
+	// Drops what Sponza hides from the visible lists
+	void CullOccluded(FXMMATRIX viewProjection);
 	void DrawTransparentEntity(Entity* entity, float blendAmount);
 	void DoubleBounceRefractionSetup(Entity* entity);
 	void DrawRefractionEntity(Entity* entity, Texture textureIn, Texture normal, Texture customDepth, bool doubleBounce);
 	void DrawSky();
 	void DrawBlur(Texture texture);
 	void DrawTransparentEntities();
-	void DrawAreaLights(Entity* entity, AreaLightType type);
+	void DrawAreaLights();
 
 	// Core Gfx
 	void TransitionResourceToState(ID3D12Resource* resource, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter);
@@ -91,11 +110,13 @@ public:
 	// AI functions
 	void CreateNavmesh();
 	AStar::CoordinateList FindPath(AStar::Vec2i source, AStar::Vec2i target);
-	XMVECTOR MoveTowards(XMVECTOR current, XMVECTOR target, float distanceDelta);
+	static XMVECTOR MoveTowards(XMVECTOR current, XMVECTOR target, float distanceDelta, int& pathIndex);
 	void AddCollider(AStar::Generator& generator, AStar::Vec2i coordinates);
 
 	// Ray picking
 	bool IsIntersecting(Entity* entity, Camera* camera, int mouseX, int mouseY, float& distance);
+	// World space ray through a pixel, direction normalized
+	void GetPickingRay(Camera* camera, int mouseX, int mouseY, XMVECTOR& origin, XMVECTOR& direction);
 
 	void OnMouseDown(WPARAM buttonState, int x, int y);
 	void OnMouseUp(WPARAM buttonState, int x, int y);
@@ -220,16 +241,23 @@ private:
 	Entity* e_discLight;
 	Entity* e_rectLight;
 
-	// Containers
-	std::vector<Entity*> entities;
-	std::vector<Entity*> selectedEntities;
+	// Containers, entities are resolved through frameManager per use
+	std::vector<EntityHandle> entities;
+	std::vector<EntityHandle> selectedEntities;
 	std::vector<TransparentEntity> transparentEntities;
 	std::vector<TransparentEntity> depthSortedEntities;
 	std::vector<Material> pbrMaterials;
-	std::vector<Entity*> pbrEntities;
-	std::map<Entity*, SphereAreaLight> sphereAreaLightMap;
-	std::map<Entity*, DiscAreaLight*> discAreaLightMap;
-	std::map<Entity*, RectAreaLight*> rectAreaLightMap;
+	std::vector<EntityHandle> pbrEntities;
+	// Frustum culled per pipeline state
+	std::vector<EntityHandle> pbrDrawEntities;
+	std::vector<EntityHandle> toonDrawEntities;
+	std::vector<EntityHandle> visiblePbrEntities;
+	std::vector<EntityHandle> visibleToonEntities;
+	// Per sub-mesh flags of the visible multi-part entities
+	std::map<EntityHandle, std::vector<uint8_t>> submeshVisibility;
+	// Scratch for the subsystems that take entity pointers, refilled per use
+	std::vector<Entity*> resolvedEntities;
+	std::vector<Entity*> culledEntities;
 
 	// constants
 	const int pbrSphereCount = 4;
@@ -252,10 +280,39 @@ private:
 	XMFLOAT3 newDestination;
 
 	// Job System
-	ThreadPool pool{ 4 };
+	static ThreadPoolSettings GetJobSystemSettings();
+	ThreadPool pool{ GetJobSystemSettings() };
+	static FrameBudgetSettings GetBackgroundBudgetSettings();
+	FrameBudgetScheduler backgroundTasks{ pool, GetBackgroundBudgetSettings() };
+	// Area lights, transparency and path agents as components
+	EcsWorld world;
+	SystemScheduler systems{ pool, world };
+	EcsEntity pathAgent;
+	float systemDeltaTime = 0.0f;
+	// Entity bounds for picking and spatial queries
+	SceneBVH sceneBVH{ pool };
+	EntityHandle pickedEntity;
+	// Entity positions for radius and nearest neighbour queries
+	SpatialHashGrid spatialGrid{ pool, SPATIAL_HASH_CELL_SIZE };
+	std::vector<EntityHandle> pickedNeighbours;
+	FrustumCuller frustumCuller{ pool };
+	OcclusionBuffer occlusionBuffer{ pool };
+	std::vector<BoundingBox> occlusionBoxes;
+	std::vector<uint32_t> occlusionSubmeshes;
+	std::vector<uint8_t> occlusionVisibility;
+	EntityUpdateStage entityUpdateStage{ pool, frameManager.GetTransformSystem(), ENTITY_UPDATE_BATCH_SIZE };
 	MyJob job1;
 	UpdatePosJob job2;
-	PathFinder pathFinderJob;
+	PathRequestQueue pathRequests{ pool, generator };
+	// Walls from obstacle footprints, baked on the background budget
+	NavGridBakeTask navGridBake{ generator, pathRequests };
+	bool isNavGridQueued = false;
+	JobCounter updateJobsCounter;
+	// Only joined on shutdown, job1 is polled through IsCompleted
+	JobCounter ioJobsCounter;
+	uint64_t frameIndex = 0;
+	uint32_t pathAgentId = 0;
+	bool bTraceKeyDown = false;
 
 	// Keeps track of the old mouse position.  Useful for 
 	// determining how far the mouse moved in a single frame.
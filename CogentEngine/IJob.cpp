@@ -2,12 +2,10 @@
 
 void IJob::SetIsCompleted(bool value)
 {
-	std::unique_lock<std::mutex> lock{ mutex };
-	mIsCompleted = value;
+	mIsCompleted.store(value, std::memory_order_release);
 }
 
 bool IJob::IsCompleted()
 {
-	std::unique_lock<std::mutex> lock{ mutex };
-	return mIsCompleted;
+	return mIsCompleted.load(std::memory_order_acquire);
 }
@@ -1,12 +1,25 @@
 #pragma once
-#include <mutex>
+#include <atomic>
+#include <cstdint>
 class IJob
 {
-	std::mutex mutex;
+	friend class ThreadPool;
+
+	std::atomic<bool> mIsCompleted{ true };
+	// Stamps of the run whose callback is executing, main thread only
+	uint64_t enqueuedFrame = 0;
+	uint64_t completedFrame = 0;
 public:
 	virtual void Execute() {};
 	virtual void Callback() {};
+	virtual const char* GetName() { return "Job"; }
 	void SetIsCompleted(bool value);
 	bool IsCompleted();
-	bool mIsCompleted = true;
+
+	// Valid during Callback: frame passed to ThreadPool::BeginFrame when the
+	// run the callback belongs to was enqueued and when it finished executing.
+	// Results belong to the enqueued frame. The stamps travel with the
+	// callback, so re-enqueueing the job before it runs doesn't change them.
+	uint64_t GetEnqueuedFrame() const { return enqueuedFrame; }
+	uint64_t GetCompletedFrame() const { return completedFrame; }
 };
\ No newline at end of file
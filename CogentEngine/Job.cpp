@@ -1,4 +1,9 @@
 #include "Job.h"
+#include "PathRequestQueue.h"
+#include "TransformSystem.h"
+#include "SystemScheduler.h"
+#include "FrustumCuller.h"
+#include "SpatialHashGrid.h"
 
 
 void MyJob::Execute()
@@ -23,12 +28,75 @@ void UpdatePosJob::Callback()
 	//cout << "Job 2 \n";
 }
 
+void EntityUpdateJob::Execute()
+{
+	for (size_t i = first; i < first + count; ++i)
+	{
+		(*animate)(entities[i], i);
+	}
+}
+
+void EntityUpdateJob::Callback()
+{
+}
+
+void TransformUpdateJob::Execute()
+{
+	transforms->UpdateRange(first, count);
+}
+
+void TransformUpdateJob::Callback()
+{
+}
+
+void TransformHierarchyJob::Execute()
+{
+	transforms->UpdateSubtrees(firstSubtree, subtreeCount);
+}
+
+void TransformHierarchyJob::Callback()
+{
+}
+
+void FrustumCullJob::Execute()
+{
+	culler->CullRange(first, count);
+}
+
+void FrustumCullJob::Callback()
+{
+}
+
+void SpatialQueryJob::Execute()
+{
+	grid->RunQueries(queries, count);
+}
+
+void SpatialQueryJob::Callback()
+{
+}
+
+void SystemJob::Execute()
+{
+	scheduler->RunSystem(systemIndex);
+}
+
+void SystemJob::Callback()
+{
+}
+
 void PathFinder::Execute()
 {
-	path = generator->findPath({(int) currentPos.x, (int)currentPos.z }, { (int)targetPos.x, (int)targetPos.z });
+	// Superseded before a worker picked it up
+	if (token.IsCancelled())
+		return;
+
+	path = generator->findPath({(int) currentPos.x, (int)currentPos.z }, { (int)targetPos.x, (int)targetPos.z }, token.GetFlag());
 }
 
 void PathFinder::Callback()
 {
-
+	if (owner)
+		owner->OnPathFinished(this);
+	isFinished = true;
 }
@@ -4,6 +4,11 @@
 #include "DXCore.h"
 #include <DirectXMath.h>
 #include "AStar.h"
+#include "CancellationToken.h"
+#include "Entity.h"
+#include <functional>
+
+class PathRequestQueue;
 
 
 class MyJob : public IJob
@@ -13,6 +18,7 @@ public:
 	// Inherited via IJob
 	virtual void Execute() override;
 	virtual void Callback() override;
+	virtual const char* GetName() override { return "MyJob"; }
 
 };
 
@@ -28,6 +34,107 @@ public:
 	// Inherited via IJob
 	virtual void Execute() override;
 	virtual void Callback() override;
+	virtual const char* GetName() override { return "UpdatePosJob"; }
+
+};
+
+class TransformSystem;
+
+// One contiguous slice of the entity list. Animation only touches entities
+// inside the slice, so batches never share writes.
+class EntityUpdateJob : public IJob
+{
+public:
+	Entity* const* entities = nullptr;
+	size_t first = 0;
+	size_t count = 0;
+	const std::function<void(Entity*, size_t)>* animate = nullptr;
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return "EntityUpdateJob"; }
+
+};
+
+// World matrices and bounds of one slice of the TransformSystem arrays
+class TransformUpdateJob : public IJob
+{
+public:
+	TransformSystem* transforms = nullptr;
+	size_t first = 0;
+	size_t count = 0;
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return "TransformUpdateJob"; }
+
+};
+
+class TransformHierarchyJob : public IJob
+{
+public:
+	TransformSystem* transforms = nullptr;
+	size_t firstSubtree = 0;
+	size_t subtreeCount = 0;
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return "TransformHierarchyJob"; }
+
+};
+
+class FrustumCuller;
+
+// Frustum tests of one slice of the gathered bounds
+class FrustumCullJob : public IJob
+{
+public:
+	FrustumCuller* culler = nullptr;
+	size_t first = 0;
+	size_t count = 0;
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return "FrustumCullJob"; }
+
+};
+
+class SpatialHashGrid;
+struct SpatialQuery;
+
+// A slice of the queries of one SpatialHashGrid::QueryBatch
+class SpatialQueryJob : public IJob
+{
+public:
+	const SpatialHashGrid* grid = nullptr;
+	SpatialQuery* queries = nullptr;
+	size_t count = 0;
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return "SpatialQueryJob"; }
+
+};
+
+class SystemScheduler;
+
+// One ECS system of the current scheduler phase
+class SystemJob : public IJob
+{
+public:
+	SystemScheduler* scheduler = nullptr;
+	size_t systemIndex = 0;
+	const char* name = "SystemJob";
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return name; }
 
 };
 
@@ -40,8 +147,16 @@ public:
 	AStar::CoordinateList path;
 	AStar::Generator* generator;
 
+	// Set by PathRequestQueue, a newer request for the same agent cancels this one
+	PathRequestQueue* owner = nullptr;
+	uint32_t agentId = 0;
+	uint64_t requestId = 0;
+	CancellationToken token;
+	bool isFinished = false;
+
 	// Inherited via IJob
 	virtual void Execute() override;
 	virtual void Callback() override;
+	virtual const char* GetName() override { return "PathFinder"; }
 
 };
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+#include <atomic>
+
+// Fence shared by a batch of jobs. Every job enqueued against the counter
+// increments it and decrements it once Execute has returned, so the batch is
+// done when the counter reaches zero. Use ThreadPool::WaitForCounter to join.
+class JobCounter
+{
+	std::atomic<int> value{ 0 };
+	std::atomic<int> lowestLane{ 0 };
+public:
+	void Increment(int amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+	int Decrement() { return value.fetch_sub(1, std::memory_order_acq_rel) - 1; }
+	bool IsZero() const { return value.load(std::memory_order_acquire) == 0; }
+	int GetValue() const { return value.load(std::memory_order_acquire); }
+
+	// Lowest priority lane, as a JobPriority value, that a job of this counter
+	// was queued on. Waiters help with pending jobs down to that lane.
+	void NoteLane(int lane)
+	{
+		int current = lowestLane.load(std::memory_order_relaxed);
+		while (current < lane && !lowestLane.compare_exchange_weak(current, lane, std::memory_order_relaxed))
+		{
+		}
+	}
+	int GetLowestLane() const { return lowestLane.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,155 @@
+#include "JobProfiler.h"
+#include <chrono>
+#include <fstream>
+
+static uint64_t SteadyNanoseconds()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static thread_local void* tlsThreadBuffer = nullptr;
+static thread_local std::string tlsThreadName;
+
+JobProfiler& JobProfiler::Get()
+{
+	static JobProfiler profiler;
+	return profiler;
+}
+
+JobProfiler::JobProfiler()
+{
+	epoch = SteadyNanoseconds();
+}
+
+uint64_t JobProfiler::Now() const
+{
+	return SteadyNanoseconds() - epoch;
+}
+
+void JobProfiler::BeginFrame(uint64_t frame)
+{
+	currentFrame.store(frame, std::memory_order_relaxed);
+	if (IsEnabled())
+	{
+		auto now = Now();
+		Record({ "Frame", now, now, now, frame, 0, JobEventType::Frame });
+	}
+}
+
+void JobProfiler::SetThreadName(const std::string& name)
+{
+	// The buffer is only allocated once the thread records something
+	tlsThreadName = name;
+	if (auto buffer = static_cast<ThreadBuffer*>(tlsThreadBuffer))
+	{
+		std::lock_guard<std::mutex> lock{ buffersMutex };
+		buffer->threadName = name;
+	}
+}
+
+JobProfiler::ThreadBuffer* JobProfiler::GetThreadBuffer()
+{
+	auto buffer = static_cast<ThreadBuffer*>(tlsThreadBuffer);
+	if (!buffer)
+	{
+		std::lock_guard<std::mutex> lock{ buffersMutex };
+		buffers.push_back(std::make_unique<ThreadBuffer>());
+		buffer = buffers.back().get();
+		buffer->threadIndex = uint32_t(buffers.size());
+		buffer->threadName = tlsThreadName.empty() ? "Thread " + std::to_string(buffer->threadIndex) : tlsThreadName;
+		tlsThreadBuffer = buffer;
+	}
+	return buffer;
+}
+
+void JobProfiler::Record(const JobEvent& event)
+{
+	auto buffer = GetThreadBuffer();
+	auto head = buffer->head.load(std::memory_order_relaxed);
+	buffer->events[head % EventsPerThread] = event;
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+static void WriteEscaped(std::ofstream& file, const char* text)
+{
+	for (; *text; ++text)
+	{
+		if (*text == '"' || *text == '\\')
+		{
+			file << '\\';
+		}
+		file << *text;
+	}
+}
+
+bool JobProfiler::WriteChromeTrace(const std::string& fileName, uint64_t firstFrame, uint64_t lastFrame)
+{
+	std::ofstream file(fileName);
+	if (!file)
+	{
+		return false;
+	}
+
+	static const char* laneNames[] = { "Critical", "Normal", "Background", "IO" };
+	static const char* categories[] = { "job", "callback", "frame" };
+
+	std::lock_guard<std::mutex> lock{ buffersMutex };
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+
+	for (auto& buffer : buffers)
+	{
+		file << (first ? "" : ",\n");
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadIndex
+			<< ",\"args\":{\"name\":\"";
+		WriteEscaped(file, buffer->threadName.c_str());
+		file << "\"}}";
+		first = false;
+
+		// The owner keeps writing while we copy. It may be in the middle of
+		// writing slot headAfter, which also holds event headAfter minus one
+		// buffer length, so only later events are known to be intact.
+		auto head = buffer->head.load(std::memory_order_acquire);
+		auto begin = head > EventsPerThread ? head - EventsPerThread : 0;
+		std::vector<JobEvent> events;
+		for (auto i = begin; i < head; ++i)
+		{
+			events.push_back(buffer->events[i % EventsPerThread]);
+		}
+		auto headAfter = buffer->head.load(std::memory_order_acquire);
+		auto firstValid = headAfter + 1 > EventsPerThread ? headAfter + 1 - EventsPerThread : 0;
+
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			auto& event = events[i];
+			if (begin + i < firstValid || event.frame < firstFrame || event.frame > lastFrame)
+			{
+				continue;
+			}
+
+			file << ",\n{\"name\":\"";
+			WriteEscaped(file, event.name);
+			file << "\",\"cat\":\"" << categories[(int)event.type] << "\",\"pid\":1,\"tid\":" << buffer->threadIndex
+				<< ",\"ts\":" << event.startTime / 1000.0;
+
+			if (event.type == JobEventType::Frame)
+			{
+				file << ",\"ph\":\"i\",\"s\":\"g\",\"args\":{\"frame\":" << event.frame << "}}";
+				continue;
+			}
+
+			file << ",\"ph\":\"X\",\"dur\":" << (event.endTime - event.startTime) / 1000.0
+				<< ",\"args\":{\"frame\":" << event.frame
+				<< ",\"waitUs\":" << (event.enqueueTime ? event.startTime - event.enqueueTime : 0) / 1000.0;
+			if (event.type == JobEventType::Job)
+			{
+				file << ",\"lane\":\"" << laneNames[event.lane] << "\"";
+			}
+			file << "}}";
+		}
+	}
+
+	file << "\n]}\n";
+	return bool(file);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class JobEventType : uint8_t
+{
+	Job,
+	Callback,
+	Frame
+};
+
+struct JobEvent
+{
+	const char* name;
+	uint64_t enqueueTime;	// ns, for callbacks the time the job finished
+	uint64_t startTime;
+	uint64_t endTime;
+	uint64_t frame;
+	uint8_t lane;
+	JobEventType type;
+};
+
+// Records per-job timings into per-thread ring buffers and exports them as a
+// chrome://tracing / Perfetto JSON file. Every thread only ever writes its own
+// buffer, so recording is lock-free; a disabled profiler costs one relaxed load.
+class JobProfiler
+{
+public:
+	static constexpr size_t EventsPerThread = 16384;
+
+	static JobProfiler& Get();
+
+	void SetEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+	bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	// Nanoseconds since the profiler was created
+	uint64_t Now() const;
+
+	void BeginFrame(uint64_t frame);
+	uint64_t GetCurrentFrame() const { return currentFrame.load(std::memory_order_relaxed); }
+
+	// Names the calling thread in exported traces
+	void SetThreadName(const std::string& name);
+
+	void Record(const JobEvent& event);
+
+	// Writes every buffered event that started in [firstFrame, lastFrame]
+	bool WriteChromeTrace(const std::string& fileName, uint64_t firstFrame, uint64_t lastFrame);
+
+private:
+	struct ThreadBuffer
+	{
+		std::unique_ptr<JobEvent[]> events{ new JobEvent[EventsPerThread] };
+		std::atomic<uint64_t> head{ 0 };
+		uint32_t threadIndex = 0;
+		std::string threadName;
+	};
+
+	JobProfiler();
+
+	ThreadBuffer* GetThreadBuffer();
+
+	std::atomic<bool> enabled{ false };
+	std::atomic<uint64_t> currentFrame{ 0 };
+	uint64_t epoch;
+
+	// Only taken when a thread registers its buffer and when exporting
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "LockStats.h"
+
+std::atomic<bool> LockStats::enabled{ false };
+
+void LockStats::StoreMax(std::atomic<uint64_t>& value, uint64_t candidate)
+{
+	uint64_t current = value.load(std::memory_order_relaxed);
+	while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed))
+	{
+	}
+}
+
+void LockStats::RecordAcquire(uint64_t waitNs, bool isContended)
+{
+	acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (isContended)
+	{
+		contentions.fetch_add(1, std::memory_order_relaxed);
+		waitNanoseconds.fetch_add(waitNs, std::memory_order_relaxed);
+		StoreMax(maxWaitNanoseconds, waitNs);
+	}
+}
+
+void LockStats::RecordHold(uint64_t holdNs)
+{
+	holdNanoseconds.fetch_add(holdNs, std::memory_order_relaxed);
+	StoreMax(maxHoldNanoseconds, holdNs);
+}
+
+void LockStats::RecordDepth(size_t depth)
+{
+	if (IsEnabled())
+	{
+		StoreMax(maxQueueDepth, depth);
+	}
+}
+
+void LockStats::RecordNotify(uint64_t count)
+{
+	if (IsEnabled())
+	{
+		notifies.fetch_add(count, std::memory_order_relaxed);
+	}
+}
+
+void LockStats::RecordWakeup()
+{
+	wakeups.fetch_add(1, std::memory_order_relaxed);
+}
+
+LockStatsSnapshot LockStats::Snapshot() const
+{
+	LockStatsSnapshot snapshot;
+	snapshot.name = name;
+	snapshot.acquisitions = acquisitions.load(std::memory_order_relaxed);
+	snapshot.contentions = contentions.load(std::memory_order_relaxed);
+	snapshot.totalWaitMs = waitNanoseconds.load(std::memory_order_relaxed) / 1e6;
+	snapshot.maxWaitUs = maxWaitNanoseconds.load(std::memory_order_relaxed) / 1e3;
+	snapshot.totalHoldMs = holdNanoseconds.load(std::memory_order_relaxed) / 1e6;
+	snapshot.maxHoldUs = maxHoldNanoseconds.load(std::memory_order_relaxed) / 1e3;
+	snapshot.maxQueueDepth = (size_t)maxQueueDepth.load(std::memory_order_relaxed);
+	snapshot.notifies = notifies.load(std::memory_order_relaxed);
+	snapshot.wakeups = wakeups.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+void LockStats::Reset()
+{
+	acquisitions.store(0, std::memory_order_relaxed);
+	contentions.store(0, std::memory_order_relaxed);
+	waitNanoseconds.store(0, std::memory_order_relaxed);
+	maxWaitNanoseconds.store(0, std::memory_order_relaxed);
+	holdNanoseconds.store(0, std::memory_order_relaxed);
+	maxHoldNanoseconds.store(0, std::memory_order_relaxed);
+	maxQueueDepth.store(0, std::memory_order_relaxed);
+	notifies.store(0, std::memory_order_relaxed);
+	wakeups.store(0, std::memory_order_relaxed);
+}
+
+void LockStats::Print(const std::vector<LockStatsSnapshot>& snapshots, FILE* file)
+{
+	for (auto& s : snapshots)
+	{
+		double contendedPercent = s.acquisitions ? 100.0 * s.contentions / s.acquisitions : 0.0;
+		fprintf(file, "%-16s locks %10llu  contended %5.1f%%  wait %8.3f ms (max %8.1f us)  hold %8.3f ms (max %8.1f us)  depth %6zu  notify %8llu  wake %8llu\n",
+			s.name, (unsigned long long)s.acquisitions, contendedPercent, s.totalWaitMs, s.maxWaitUs,
+			s.totalHoldMs, s.maxHoldUs, s.maxQueueDepth, (unsigned long long)s.notifies, (unsigned long long)s.wakeups);
+	}
+}
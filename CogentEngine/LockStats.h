@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+struct LockStatsSnapshot
+{
+	const char* name = "";
+	uint64_t acquisitions = 0;
+	uint64_t contentions = 0;	// acquisitions that had to wait for another thread
+	double totalWaitMs = 0.0;
+	double maxWaitUs = 0.0;
+	double totalHoldMs = 0.0;
+	double maxHoldUs = 0.0;
+	size_t maxQueueDepth = 0;
+	uint64_t notifies = 0;		// notify calls made on the queue's condition variable
+	uint64_t wakeups = 0;		// waits that returned after blocking
+};
+
+// Contention counters for one mutex and the queue it guards. Recording is
+// off by default and switched on for all instances at once; while off,
+// locking through InstrumentedLock costs one relaxed load.
+class LockStats
+{
+public:
+	explicit LockStats(const char* name) : name(name) {}
+
+	static void SetEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+	static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+	static uint64_t Now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void RecordAcquire(uint64_t waitNs, bool isContended);
+	void RecordHold(uint64_t holdNs);
+	void RecordDepth(size_t depth);
+	void RecordNotify(uint64_t count = 1);
+	void RecordWakeup();
+
+	LockStatsSnapshot Snapshot() const;
+	void Reset();
+
+	// One line per snapshot, for periodic logging
+	static void Print(const std::vector<LockStatsSnapshot>& snapshots, FILE* file = stdout);
+
+private:
+	static void StoreMax(std::atomic<uint64_t>& value, uint64_t candidate);
+
+	static std::atomic<bool> enabled;
+
+	const char* name;
+	std::atomic<uint64_t> acquisitions{ 0 };
+	std::atomic<uint64_t> contentions{ 0 };
+	std::atomic<uint64_t> waitNanoseconds{ 0 };
+	std::atomic<uint64_t> maxWaitNanoseconds{ 0 };
+	std::atomic<uint64_t> holdNanoseconds{ 0 };
+	std::atomic<uint64_t> maxHoldNanoseconds{ 0 };
+	std::atomic<uint64_t> maxQueueDepth{ 0 };
+	std::atomic<uint64_t> notifies{ 0 };
+	std::atomic<uint64_t> wakeups{ 0 };
+};
+
+// unique_lock stand-in that reports wait and hold times to a LockStats.
+// Time spent inside Wait is not counted as held.
+class InstrumentedLock
+{
+public:
+	InstrumentedLock(std::mutex& mtx, LockStats& stats) : lock(mtx, std::defer_lock), stats(stats) { Lock(); }
+	~InstrumentedLock() { if (lock.owns_lock()) Unlock(); }
+
+	InstrumentedLock(const InstrumentedLock&) = delete;
+	InstrumentedLock& operator=(const InstrumentedLock&) = delete;
+
+	void Lock()
+	{
+		if (!LockStats::IsEnabled())
+		{
+			lock.lock();
+			holdStart = 0;
+			return;
+		}
+
+		if (lock.try_lock())
+		{
+			stats.RecordAcquire(0, false);
+		}
+		else
+		{
+			auto waitStart = LockStats::Now();
+			lock.lock();
+			stats.RecordAcquire(LockStats::Now() - waitStart, true);
+		}
+		holdStart = LockStats::Now();
+	}
+
+	void Unlock()
+	{
+		EndHold();
+		lock.unlock();
+	}
+
+	void Wait(std::condition_variable& cv)
+	{
+		EndHold();
+		cv.wait(lock);
+		OnWakeup();
+	}
+
+	template<typename Predicate>
+	void Wait(std::condition_variable& cv, Predicate predicate)
+	{
+		if (predicate())
+			return;
+		EndHold();
+		cv.wait(lock, predicate);
+		OnWakeup();
+	}
+
+private:
+	void EndHold()
+	{
+		if (holdStart)
+		{
+			stats.RecordHold(LockStats::Now() - holdStart);
+			holdStart = 0;
+		}
+	}
+
+	void OnWakeup()
+	{
+		if (LockStats::IsEnabled())
+		{
+			stats.RecordWakeup();
+			holdStart = LockStats::Now();
+		}
+	}
+
+	std::unique_lock<std::mutex> lock;
+	LockStats& stats;
+	uint64_t holdStart = 0;
+};
@@ -14,6 +14,8 @@ struct MeshEntry
 	int NumIndices;
 	int BaseVertex;
 	int BaseIndex;
+	// Mesh space bounds of this sub-mesh's vertices
+	BoundingBox Bounds;
 };
 
 struct MeshData
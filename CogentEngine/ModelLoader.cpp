@@ -138,6 +138,12 @@ ModelData ModelLoader::LoadComplexModel(std::string filename, ID3D12Device * dev
 		std::vector<uint32_t> indices;
 		ProcessMesh(pScene->mMeshes[i], pScene, vertices, indices);
 
+		// Per sub-mesh bounds so parts off screen can be culled individually
+		if (!vertices.empty())
+		{
+			BoundingBox::CreateFromPoints(meshEntries[i].Bounds, vertices.size(), &vertices[0].Position, sizeof(Vertex));
+		}
+
 		meshVertices.insert(meshVertices.end(), vertices.begin(), vertices.end());
 		meshIndices.insert(meshIndices.end(), indices.begin(), indices.end());
 	}
@@ -179,11 +185,34 @@ ModelData ModelLoader::LoadComplexModel(std::string filename, ID3D12Device * dev
 				mMat.Metalness = metalnessTexture.C_Str();
 			}
 
+			mMat.AlphaMasked = mat->GetTextureCount(aiTextureType_OPACITY) > 0;
+
 
 			materials[i] = mMat;
 		}
 
 	}
 
-	return ModelData{mesh, materials};
+	ModelData model{mesh, materials};
+
+	// Triangles are kept relative to the size of the whole model
+	BoundingBox modelBounds;
+	if (!meshVertices.empty())
+	{
+		BoundingBox::CreateFromPoints(modelBounds, meshVertices.size(), &meshVertices[0].Position, sizeof(Vertex));
+	}
+	XMFLOAT3 extents = modelBounds.Extents;
+	float diagonalSquared = 4.0f * (extents.x * extents.x + extents.y * extents.y + extents.z * extents.z);
+	for (uint32_t i = 0; i < meshEntries.size(); ++i)
+	{
+		// Foliage and chains are mostly holes, they would hide what shows through
+		auto& entry = meshEntries[i];
+		if (entry.NumIndices == 0 || materials[i].AlphaMasked)
+			continue;
+
+		AppendOccluderTriangles(&meshVertices[entry.BaseVertex].Position, sizeof(Vertex), &meshIndices[entry.BaseIndex], entry.NumIndices,
+			diagonalSquared * OCCLUDER_MIN_AREA_RATIO, model.Occluder);
+	}
+
+	return model;
 }
@@ -6,6 +6,7 @@
 #include "Mesh.h"
 #include <vector>
 #include "Vertex.h"
+#include "OcclusionBuffer.h"
 
 struct MeshMaterial
 {
@@ -13,12 +14,16 @@ struct MeshMaterial
 	std::string Normal;
 	std::string Roughness;
 	std::string Metalness;
+	// Has an opacity map, the shader clips the cut out parts
+	bool AlphaMasked = false;
 };
 
 struct ModelData
 {
 	Mesh*						Mesh;
 	std::vector<MeshMaterial>	Materials;
+	// Large triangles of every opaque sub-mesh, for CPU occlusion culling
+	OccluderMesh				Occluder;
 };
 
 class ModelLoader
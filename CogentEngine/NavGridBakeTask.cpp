@@ -0,0 +1,54 @@
+#include "NavGridBakeTask.h"
+#include <cmath>
+
+NavGridBakeTask::NavGridBakeTask(AStar::Generator& generator, PathRequestQueue& pathRequests)
+	: generator(generator), pathRequests(pathRequests)
+{
+}
+
+void NavGridBakeTask::Reset(AStar::Vec2i worldSize, std::vector<BoundingBox> obstacles)
+{
+	this->worldSize = worldSize;
+	this->obstacles = std::move(obstacles);
+	nextRow = 0;
+	walls.clear();
+}
+
+bool NavGridBakeTask::Step()
+{
+	if (nextRow >= worldSize.y)
+		return true;
+
+	// A cell is the unit square around its node, blocked by any footprint overlapping it
+	float z = (float)nextRow;
+	for (int x = 0; x < worldSize.x; ++x)
+	{
+		for (const BoundingBox& box : obstacles)
+		{
+			if (fabsf(box.Center.x - x) < box.Extents.x + 0.5f && fabsf(box.Center.z - z) < box.Extents.z + 0.5f)
+			{
+				walls.push_back({ x, nextRow });
+				break;
+			}
+		}
+	}
+	return ++nextRow >= worldSize.y;
+}
+
+void NavGridBakeTask::OnComplete()
+{
+	// Searches read the walls unlocked, let the running ones finish first
+	pathRequests.WaitForSearches();
+
+	// Colliders added by hand stay, only the previous bake is replaced
+	for (auto& wall : appliedWalls)
+	{
+		generator.removeCollision(wall);
+	}
+	for (auto& wall : walls)
+	{
+		generator.addCollision(wall);
+	}
+	appliedWalls = std::move(walls);
+	walls.clear();
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <DirectXCollision.h>
+#include "AStar.h"
+#include "FrameBudgetScheduler.h"
+#include "PathRequestQueue.h"
+
+using namespace DirectX;
+
+// Rebuilds the path grid's walls from obstacle bounds, one grid row per
+// step on the background budget. Cells are world x and z like path nodes.
+// The walls reach the generator in OnComplete, once no search reads it.
+class NavGridBakeTask : public ITimeSlicedTask
+{
+public:
+	NavGridBakeTask(AStar::Generator& generator, PathRequestQueue& pathRequests);
+
+	// Main thread, only while the task is not added to a scheduler
+	void Reset(AStar::Vec2i worldSize, std::vector<BoundingBox> obstacles);
+
+	bool Step() override;
+	void OnComplete() override;
+	const char* GetName() override { return "NavGridBake"; }
+
+	size_t GetBakedWallCount() const { return appliedWalls.size(); }
+
+private:
+	AStar::Generator& generator;
+	PathRequestQueue& pathRequests;
+	AStar::Vec2i worldSize = { 0, 0 };
+	std::vector<BoundingBox> obstacles;
+	int nextRow = 0;
+	// Walls of the bake in progress, and of the last one handed to the generator
+	AStar::CoordinateList walls;
+	AStar::CoordinateList appliedWalls;
+};
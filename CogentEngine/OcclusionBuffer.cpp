@@ -0,0 +1,564 @@
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define OCCLUSION_BUFFER_SSE 1
+#endif
+
+void AppendOccluderTriangles(const XMFLOAT3* positions, size_t positionStride, const uint32_t* indices, size_t indexCount,
+	float minArea, OccluderMesh& occluder)
+{
+	auto position = [positions, positionStride](uint32_t index)
+	{
+		return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const char*>(positions) + index * positionStride));
+	};
+
+	// Only the vertices a kept triangle uses are copied
+	std::vector<uint32_t> remap;
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		XMVECTOR a = position(indices[i]);
+		XMVECTOR b = position(indices[i + 1]);
+		XMVECTOR c = position(indices[i + 2]);
+		float area = 0.5f * XMVectorGetX(XMVector3Length(XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a))));
+		if (area < minArea)
+			continue;
+
+		for (size_t k = 0; k < 3; ++k)
+		{
+			uint32_t index = indices[i + k];
+			if (index >= remap.size())
+			{
+				remap.resize(index + 1, UINT32_MAX);
+			}
+			if (remap[index] == UINT32_MAX)
+			{
+				remap[index] = (uint32_t)occluder.positions.size();
+				XMFLOAT3 p;
+				XMStoreFloat3(&p, position(index));
+				occluder.positions.push_back(p);
+			}
+			occluder.indices.push_back(remap[index]);
+		}
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer(ThreadPool& pool)
+	: pool(pool)
+{
+	depth.assign(OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT, 1.0f);
+	for (auto& maxDepth : tileMaxDepth)
+	{
+		maxDepth = 1.0f;
+	}
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+}
+
+OcclusionJob* OcclusionBuffer::GetJob(size_t index)
+{
+	while (jobs.size() <= index)
+	{
+		jobs.push_back(std::make_unique<OcclusionJob>());
+	}
+	jobs[index]->buffer = this;
+	return jobs[index].get();
+}
+
+void OcclusionBuffer::RunJobs(size_t jobCount)
+{
+	if (jobCount == 1)
+	{
+		jobs[0]->Execute();
+		return;
+	}
+
+	jobPointers.clear();
+	for (size_t i = 0; i < jobCount; ++i)
+	{
+		jobPointers.push_back(jobs[i].get());
+	}
+
+	pool.EnqueueBatch(jobPointers, &jobsCounter, JobPriority::Critical);
+	pool.WaitForCounter(&jobsCounter);
+}
+
+void OcclusionBuffer::BeginScene(FXMMATRIX viewProjection)
+{
+	XMStoreFloat4x4(&this->viewProjection, viewProjection);
+	occluders.clear();
+	clipVertices.clear();
+	stats = OcclusionStats();
+}
+
+void OcclusionBuffer::AddOccluder(const OccluderMesh* mesh, const XMFLOAT4X4& worldTransposed)
+{
+	Occluder occluder;
+	occluder.mesh = mesh;
+	occluder.firstClipVertex = clipVertices.size();
+	XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&worldTransposed));
+	XMStoreFloat4x4(&occluder.toClip, XMMatrixMultiply(world, XMLoadFloat4x4(&viewProjection)));
+	occluders.push_back(occluder);
+
+	clipVertices.resize(clipVertices.size() + mesh->positions.size());
+	stats.occluderTriangles += (uint32_t)(mesh->indices.size() / 3);
+}
+
+void OcclusionBuffer::Rasterize()
+{
+	// Model to clip space, every vertex once
+	size_t jobCount = 0;
+	for (size_t o = 0; o < occluders.size(); ++o)
+	{
+		size_t vertexCount = occluders[o].mesh->positions.size();
+		for (size_t first = 0; first < vertexCount; first += OCCLUSION_TRIANGLE_BATCH_SIZE)
+		{
+			auto job = GetJob(jobCount++);
+			job->stage = OcclusionStage::Transform;
+			job->name = "OcclusionTransformJob";
+			job->occluder = o;
+			job->first = first;
+			job->count = std::min((size_t)OCCLUSION_TRIANGLE_BATCH_SIZE, vertexCount - first);
+		}
+	}
+	RunJobs(jobCount);
+
+	// Clip and bin, one set of tile bins per job
+	jobCount = 0;
+	for (size_t o = 0; o < occluders.size(); ++o)
+	{
+		size_t triangleCount = occluders[o].mesh->indices.size() / 3;
+		for (size_t first = 0; first < triangleCount; first += OCCLUSION_TRIANGLE_BATCH_SIZE)
+		{
+			auto job = GetJob(jobCount);
+			job->stage = OcclusionStage::Bin;
+			job->name = "OcclusionBinJob";
+			job->occluder = o;
+			job->first = first;
+			job->count = std::min((size_t)OCCLUSION_TRIANGLE_BATCH_SIZE, triangleCount - first);
+			job->binSet = jobCount++;
+		}
+	}
+
+	binSetCount = jobCount;
+	if (bins.size() < binSetCount * TILE_COUNT)
+	{
+		bins.resize(binSetCount * TILE_COUNT);
+	}
+	for (size_t i = 0; i < binSetCount * TILE_COUNT; ++i)
+	{
+		bins[i].clear();
+	}
+	binnedCounts.assign(binSetCount, 0);
+	RunJobs(jobCount);
+
+	// One row of tiles per job, tiles never share pixels
+	for (uint32_t row = 0; row < TILES_Y; ++row)
+	{
+		auto job = GetJob(row);
+		job->stage = OcclusionStage::Raster;
+		job->name = "OcclusionRasterJob";
+		job->first = row * TILES_X;
+		job->count = TILES_X;
+	}
+	RunJobs(TILES_Y);
+
+	for (uint32_t count : binnedCounts)
+	{
+		stats.rasterizedTriangles += count;
+	}
+}
+
+void OcclusionJob::Execute()
+{
+	buffer->RunJob(*this);
+}
+
+void OcclusionJob::Callback()
+{
+}
+
+void OcclusionBuffer::RunJob(const OcclusionJob& job)
+{
+	switch (job.stage)
+	{
+	case OcclusionStage::Transform:
+		TransformVertices(job.occluder, job.first, job.count);
+		break;
+	case OcclusionStage::Bin:
+		BinTriangles(job.occluder, job.first, job.count, job.binSet);
+		break;
+	case OcclusionStage::Raster:
+		RasterizeTiles(job.first, job.count);
+		break;
+	case OcclusionStage::Test:
+	{
+		XMMATRIX boxToClip = XMLoadFloat4x4(&testRange.boxToClip);
+		for (size_t i = job.first; i < job.first + job.count; ++i)
+		{
+			testRange.visible[i] = IsVisible(testRange.boxes[i], boxToClip);
+		}
+		break;
+	}
+	}
+}
+
+void OcclusionBuffer::TransformVertices(size_t occluderIndex, size_t first, size_t count)
+{
+	const Occluder& occluder = occluders[occluderIndex];
+	XMMATRIX toClip = XMLoadFloat4x4(&occluder.toClip);
+	const XMFLOAT3* positions = occluder.mesh->positions.data();
+	XMFLOAT4* clip = clipVertices.data() + occluder.firstClipVertex;
+	for (size_t i = first; i < first + count; ++i)
+	{
+		XMStoreFloat4(&clip[i], XMVector3Transform(XMLoadFloat3(&positions[i]), toClip));
+	}
+}
+
+void OcclusionBuffer::BinTriangles(size_t occluderIndex, size_t firstTriangle, size_t triangleCount, size_t binSet)
+{
+	const Occluder& occluder = occluders[occluderIndex];
+	const XMFLOAT4* clip = clipVertices.data() + occluder.firstClipVertex;
+	const uint32_t* indices = occluder.mesh->indices.data();
+	for (size_t t = firstTriangle; t < firstTriangle + triangleCount; ++t)
+	{
+		BinTriangle(clip[indices[3 * t]], clip[indices[3 * t + 1]], clip[indices[3 * t + 2]], binSet);
+	}
+}
+
+namespace
+{
+	const uint32_t OUTSIDE_NEAR = 1 << 5;
+
+	uint32_t GetOutcode(const XMFLOAT4& v)
+	{
+		return (v.x > v.w ? 1 : 0) | (v.x < -v.w ? 2 : 0) | (v.y > v.w ? 4 : 0) | (v.y < -v.w ? 8 : 0) |
+			(v.z > v.w ? 16 : 0) | (v.z < 0.0f ? OUTSIDE_NEAR : 0);
+	}
+
+	XMFLOAT4 Lerp(const XMFLOAT4& a, const XMFLOAT4& b, float t)
+	{
+		return XMFLOAT4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+	}
+}
+
+void OcclusionBuffer::BinTriangle(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c, size_t binSet)
+{
+	uint32_t outA = GetOutcode(a), outB = GetOutcode(b), outC = GetOutcode(c);
+	if (outA & outB & outC)
+		return;
+
+	// Clipping to z >= 0 leaves at most a quad
+	XMFLOAT4 polygon[4];
+	uint32_t vertexCount = 0;
+	if ((outA | outB | outC) & OUTSIDE_NEAR)
+	{
+		const XMFLOAT4* input[3] = { &a, &b, &c };
+		for (int i = 0; i < 3; ++i)
+		{
+			const XMFLOAT4& current = *input[i];
+			const XMFLOAT4& next = *input[(i + 1) % 3];
+			if (current.z >= 0.0f)
+			{
+				polygon[vertexCount++] = current;
+			}
+			if ((current.z >= 0.0f) != (next.z >= 0.0f))
+			{
+				polygon[vertexCount++] = Lerp(current, next, current.z / (current.z - next.z));
+			}
+		}
+	}
+	else
+	{
+		polygon[0] = a;
+		polygon[1] = b;
+		polygon[2] = c;
+		vertexCount = 3;
+	}
+
+	float sx[4], sy[4], sz[4];
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		float invW = 1.0f / polygon[i].w;
+		sx[i] = (polygon[i].x * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+		sy[i] = (0.5f - polygon[i].y * invW * 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+		sz[i] = polygon[i].z * invW;
+	}
+
+	// Fan out of the first vertex
+	for (uint32_t i = 1; i + 1 < vertexCount; ++i)
+	{
+		uint32_t v[3] = { 0, i, i + 1 };
+		float area = (sx[v[1]] - sx[v[0]]) * (sy[v[2]] - sy[v[0]]) - (sx[v[2]] - sx[v[0]]) * (sy[v[1]] - sy[v[0]]);
+		if (fabsf(area) < 1e-6f)
+			continue;
+
+		// Same winding for every triangle, so inside is all edges >= 0
+		if (area < 0.0f)
+		{
+			std::swap(v[1], v[2]);
+		}
+
+		BinnedTriangle triangle;
+		float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+		for (int k = 0; k < 3; ++k)
+		{
+			triangle.x[k] = sx[v[k]];
+			triangle.y[k] = sy[v[k]];
+			triangle.z[k] = sz[v[k]];
+			minX = std::min(minX, sx[v[k]]);
+			maxX = std::max(maxX, sx[v[k]]);
+			minY = std::min(minY, sy[v[k]]);
+			maxY = std::max(maxY, sy[v[k]]);
+		}
+
+		// Pixels whose centers fall inside the bounds
+		int pixelX0 = std::max(0, (int)ceilf(minX - 0.5f));
+		int pixelX1 = std::min((int)OCCLUSION_BUFFER_WIDTH - 1, (int)floorf(maxX - 0.5f));
+		int pixelY0 = std::max(0, (int)ceilf(minY - 0.5f));
+		int pixelY1 = std::min((int)OCCLUSION_BUFFER_HEIGHT - 1, (int)floorf(maxY - 0.5f));
+		if (pixelX0 > pixelX1 || pixelY0 > pixelY1)
+			continue;
+
+		std::vector<BinnedTriangle>* binSetBins = &bins[binSet * TILE_COUNT];
+		for (int tileY = pixelY0 / OCCLUSION_TILE_HEIGHT; tileY <= pixelY1 / (int)OCCLUSION_TILE_HEIGHT; ++tileY)
+		{
+			for (int tileX = pixelX0 / OCCLUSION_TILE_WIDTH; tileX <= pixelX1 / (int)OCCLUSION_TILE_WIDTH; ++tileX)
+			{
+				binSetBins[tileY * TILES_X + tileX].push_back(triangle);
+			}
+		}
+		binnedCounts[binSet]++;
+	}
+}
+
+void OcclusionBuffer::RasterizeTiles(size_t firstTile, size_t tileCount)
+{
+	for (size_t tile = firstTile; tile < firstTile + tileCount; ++tile)
+	{
+		uint32_t tileX = (uint32_t)(tile % TILES_X);
+		uint32_t tileY = (uint32_t)(tile / TILES_X);
+		for (uint32_t y = 0; y < OCCLUSION_TILE_HEIGHT; ++y)
+		{
+			float* row = &depth[(tileY * OCCLUSION_TILE_HEIGHT + y) * OCCLUSION_BUFFER_WIDTH + tileX * OCCLUSION_TILE_WIDTH];
+			std::fill(row, row + OCCLUSION_TILE_WIDTH, 1.0f);
+		}
+
+		// Bin sets in job order keeps the result independent of scheduling
+		for (size_t binSet = 0; binSet < binSetCount; ++binSet)
+		{
+			for (const BinnedTriangle& triangle : bins[binSet * TILE_COUNT + tile])
+			{
+				RasterizeTriangle(triangle, tileX, tileY);
+			}
+		}
+
+		float maxDepth = 0.0f;
+		for (uint32_t y = 0; y < OCCLUSION_TILE_HEIGHT; ++y)
+		{
+			const float* row = &depth[(tileY * OCCLUSION_TILE_HEIGHT + y) * OCCLUSION_BUFFER_WIDTH + tileX * OCCLUSION_TILE_WIDTH];
+			maxDepth = std::max(maxDepth, *std::max_element(row, row + OCCLUSION_TILE_WIDTH));
+		}
+		tileMaxDepth[tile] = maxDepth;
+	}
+}
+
+void OcclusionBuffer::RasterizeTriangle(const BinnedTriangle& triangle, uint32_t tileX, uint32_t tileY)
+{
+	const float* x = triangle.x;
+	const float* y = triangle.y;
+	const float* z = triangle.z;
+
+	int tileX0 = (int)(tileX * OCCLUSION_TILE_WIDTH);
+	int tileY0 = (int)(tileY * OCCLUSION_TILE_HEIGHT);
+	int pixelX0 = std::max(tileX0, (int)ceilf(std::min({ x[0], x[1], x[2] }) - 0.5f));
+	int pixelX1 = std::min(tileX0 + (int)OCCLUSION_TILE_WIDTH - 1, (int)floorf(std::max({ x[0], x[1], x[2] }) - 0.5f));
+	int pixelY0 = std::max(tileY0, (int)ceilf(std::min({ y[0], y[1], y[2] }) - 0.5f));
+	int pixelY1 = std::min(tileY0 + (int)OCCLUSION_TILE_HEIGHT - 1, (int)floorf(std::max({ y[0], y[1], y[2] }) - 0.5f));
+	if (pixelX0 > pixelX1 || pixelY0 > pixelY1)
+		return;
+
+	// Edge i runs from vertex i to vertex i + 1, e(p) = a * x + b * y + c
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		int j = (i + 1) % 3;
+		edgeA[i] = y[i] - y[j];
+		edgeB[i] = x[j] - x[i];
+		edgeC[i] = -(edgeA[i] * x[i] + edgeB[i] * y[i]);
+	}
+
+	// Depth is linear in screen space
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	float depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	float depthB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+	float depthC = z[0] - depthA * x[0] - depthB * y[0];
+
+#ifdef OCCLUSION_BUFFER_SSE
+	// Four pixels of a row per step, tiles are a multiple of 4 wide
+	int startX = pixelX0 & ~3;
+	__m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+	__m128 aDepth = _mm_set1_ps(depthA);
+	for (int py = pixelY0; py <= pixelY1; ++py)
+	{
+		float centerY = py + 0.5f;
+		__m128 rowE0 = _mm_set1_ps(edgeB[0] * centerY + edgeC[0]);
+		__m128 rowE1 = _mm_set1_ps(edgeB[1] * centerY + edgeC[1]);
+		__m128 rowE2 = _mm_set1_ps(edgeB[2] * centerY + edgeC[2]);
+		__m128 rowDepth = _mm_set1_ps(depthB * centerY + depthC);
+		float* row = &depth[py * OCCLUSION_BUFFER_WIDTH];
+		for (int px = startX; px <= pixelX1; px += 4)
+		{
+			__m128 centerX = _mm_add_ps(_mm_set1_ps((float)px), laneX);
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, centerX), rowE0);
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, centerX), rowE1);
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, centerX), rowE2);
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(aDepth, centerX), rowDepth);
+			__m128 stored = _mm_loadu_ps(&row[px]);
+			__m128 nearest = _mm_min_ps(stored, pixelDepth);
+			_mm_storeu_ps(&row[px], _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+		}
+	}
+#else
+	for (int py = pixelY0; py <= pixelY1; ++py)
+	{
+		float centerY = py + 0.5f;
+		float* row = &depth[py * OCCLUSION_BUFFER_WIDTH];
+		for (int px = pixelX0; px <= pixelX1; ++px)
+		{
+			float centerX = px + 0.5f;
+			bool inside = true;
+			for (int i = 0; i < 3; ++i)
+			{
+				inside = inside && edgeA[i] * centerX + edgeB[i] * centerY + edgeC[i] >= 0.0f;
+			}
+			if (inside)
+			{
+				row[px] = std::min(row[px], depthA * centerX + depthB * centerY + depthC);
+			}
+		}
+	}
+#endif
+}
+
+bool OcclusionBuffer::IsVisible(const BoundingBox& box, CXMMATRIX boxToClip) const
+{
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	box.GetCorners(corners);
+
+	float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+	for (const XMFLOAT3& corner : corners)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corner), boxToClip));
+		// Reaches past the near plane, the camera may be inside
+		if (clip.z < 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+		float y = (0.5f - clip.y * invW * 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z * invW);
+	}
+
+	// Every pixel the rectangle touches
+	int pixelX0 = std::max(0, (int)floorf(minX));
+	int pixelX1 = std::min((int)OCCLUSION_BUFFER_WIDTH - 1, (int)floorf(maxX));
+	int pixelY0 = std::max(0, (int)floorf(minY));
+	int pixelY1 = std::min((int)OCCLUSION_BUFFER_HEIGHT - 1, (int)floorf(maxY));
+	// Off screen or past the far plane is left to frustum culling
+	if (pixelX0 > pixelX1 || pixelY0 > pixelY1 || minZ > 1.0f)
+		return true;
+
+	// A surface is often its own occluder, its box then touches the depth it
+	// wrote and rounding must not decide whether it hides itself
+	float testZ = minZ - OCCLUSION_DEPTH_BIAS;
+
+	for (int tileY = pixelY0 / OCCLUSION_TILE_HEIGHT; tileY <= pixelY1 / (int)OCCLUSION_TILE_HEIGHT; ++tileY)
+	{
+		for (int tileX = pixelX0 / OCCLUSION_TILE_WIDTH; tileX <= pixelX1 / (int)OCCLUSION_TILE_WIDTH; ++tileX)
+		{
+			// Every occluder pixel of this tile is in front of the box
+			if (testZ > tileMaxDepth[tileY * TILES_X + tileX])
+				continue;
+
+			int x0 = std::max(pixelX0, tileX * (int)OCCLUSION_TILE_WIDTH);
+			int x1 = std::min(pixelX1, (tileX + 1) * (int)OCCLUSION_TILE_WIDTH - 1);
+			int y0 = std::max(pixelY0, tileY * (int)OCCLUSION_TILE_HEIGHT);
+			int y1 = std::min(pixelY1, (tileY + 1) * (int)OCCLUSION_TILE_HEIGHT - 1);
+#ifdef OCCLUSION_BUFFER_SSE
+			__m128 boxDepth = _mm_set1_ps(testZ);
+			__m128 laneX = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			for (int py = y0; py <= y1; ++py)
+			{
+				const float* row = &depth[py * OCCLUSION_BUFFER_WIDTH];
+				for (int px = x0 & ~3; px <= x1; px += 4)
+				{
+					__m128 lane = _mm_add_ps(_mm_set1_ps((float)px), laneX);
+					__m128 inRange = _mm_and_ps(_mm_cmpge_ps(lane, _mm_set1_ps((float)x0)), _mm_cmple_ps(lane, _mm_set1_ps((float)x1)));
+					__m128 behind = _mm_cmpge_ps(_mm_loadu_ps(&row[px]), boxDepth);
+					if (_mm_movemask_ps(_mm_and_ps(inRange, behind)))
+						return true;
+				}
+			}
+#else
+			for (int py = y0; py <= y1; ++py)
+			{
+				const float* row = &depth[py * OCCLUSION_BUFFER_WIDTH];
+				for (int px = x0; px <= x1; ++px)
+				{
+					if (row[px] >= testZ)
+						return true;
+				}
+			}
+#endif
+		}
+	}
+
+	return false;
+}
+
+void OcclusionBuffer::TestBoxes(const std::vector<BoundingBox>& boxes, const XMFLOAT4X4& worldTransposed, std::vector<uint8_t>& visible)
+{
+	visible.resize(boxes.size());
+	if (boxes.empty())
+		return;
+
+	XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&worldTransposed));
+	testRange.boxes = boxes.data();
+	testRange.visible = visible.data();
+	XMStoreFloat4x4(&testRange.boxToClip, XMMatrixMultiply(world, XMLoadFloat4x4(&viewProjection)));
+
+	size_t jobCount = 0;
+	for (size_t first = 0; first < boxes.size(); first += OCCLUSION_TEST_BATCH_SIZE)
+	{
+		auto job = GetJob(jobCount++);
+		job->stage = OcclusionStage::Test;
+		job->name = "OcclusionTestJob";
+		job->first = first;
+		job->count = std::min((size_t)OCCLUSION_TEST_BATCH_SIZE, boxes.size() - first);
+	}
+	RunJobs(jobCount);
+
+	stats.tested += (uint32_t)boxes.size();
+	for (uint8_t flag : visible)
+	{
+		stats.occluded += flag ? 0 : 1;
+	}
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "Constants.h"
+#include "ThreadPool.h"
+#include "JobCounter.h"
+
+using namespace DirectX;
+
+// Triangle list rasterized as an occluder, in model space
+struct OccluderMesh
+{
+	std::vector<XMFLOAT3> positions;
+	std::vector<uint32_t> indices;
+};
+
+// Appends the triangles of one sub-mesh whose area is at least minArea.
+// Dropping the small ones keeps walls and columns and loses detail, and the
+// result never covers more than the real mesh.
+void AppendOccluderTriangles(const XMFLOAT3* positions, size_t positionStride, const uint32_t* indices, size_t indexCount,
+	float minArea, OccluderMesh& occluder);
+
+struct OcclusionStats
+{
+	uint32_t occluderTriangles = 0;
+	uint32_t rasterizedTriangles = 0;
+	uint32_t tested = 0;
+	uint32_t occluded = 0;
+};
+
+enum class OcclusionStage
+{
+	Transform,
+	Bin,
+	Raster,
+	Test,
+};
+
+class OcclusionBuffer;
+
+// One slice of a software occlusion pass: occluder vertices, occluder
+// triangles, tiles or test boxes depending on the stage. Kept here rather
+// than in Job.h, which pulls in D3D, so the buffer also builds headless.
+class OcclusionJob : public IJob
+{
+public:
+	OcclusionBuffer* buffer = nullptr;
+	OcclusionStage stage = OcclusionStage::Transform;
+	size_t occluder = 0;
+	size_t first = 0;
+	size_t count = 0;
+	size_t binSet = 0;
+	const char* name = "OcclusionJob";
+
+	// Inherited via IJob
+	virtual void Execute() override;
+	virtual void Callback() override;
+	virtual const char* GetName() override { return name; }
+
+};
+
+// Low resolution depth buffer rendered on the CPU from a few occluder meshes,
+// used to skip objects hidden behind them. No graphics API involved.
+//
+// Rasterize runs in three job passes: occluder vertices are transformed to
+// clip space, triangles are clipped to the near plane and binned into screen
+// tiles, and every tile is rasterized by one job, four pixels at a time with
+// SSE. Each bin job owns its own set of tile bins, so binning takes no locks.
+//
+// Boxes are tested by projecting their corners: a box is occluded when the
+// nearest corner is behind the stored depth at every pixel of its screen
+// rectangle. Per tile maximum depths reject most of those pixels at once.
+// Depth is sampled at pixel centers, like the GPU does.
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer(ThreadPool& pool);
+	~OcclusionBuffer();
+
+	// Starts a new frame seen through a row vector view * projection matrix,
+	// D3D clip space. Drops the occluders of the last frame.
+	void BeginScene(FXMMATRIX viewProjection);
+	// The mesh must stay alive until Rasterize returns
+	void AddOccluder(const OccluderMesh* mesh, const XMFLOAT4X4& worldTransposed);
+	void Rasterize();
+
+	// After Rasterize. True unless the box is hidden by the occluders.
+	bool IsVisible(const BoundingBox& box, CXMMATRIX boxToClip) const;
+	// One flag per box given in the space of the transposed world matrix
+	void TestBoxes(const std::vector<BoundingBox>& boxes, const XMFLOAT4X4& worldTransposed, std::vector<uint8_t>& visible);
+
+	// Job entry point, jobs of the same stage may run on different threads
+	void RunJob(const OcclusionJob& job);
+
+	// Row major, 0 nearest, 1 where nothing was drawn
+	const std::vector<float>& GetDepthBuffer() const { return depth; }
+	uint32_t GetWidth() const { return OCCLUSION_BUFFER_WIDTH; }
+	uint32_t GetHeight() const { return OCCLUSION_BUFFER_HEIGHT; }
+	// Counts since the last BeginScene
+	const OcclusionStats& GetStats() const { return stats; }
+
+private:
+	static const uint32_t TILES_X = OCCLUSION_BUFFER_WIDTH / OCCLUSION_TILE_WIDTH;
+	static const uint32_t TILES_Y = OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_HEIGHT;
+	static const uint32_t TILE_COUNT = TILES_X * TILES_Y;
+
+	struct Occluder
+	{
+		const OccluderMesh* mesh;
+		XMFLOAT4X4 toClip;
+		size_t firstClipVertex;
+	};
+
+	// Screen space in pixels, z is depth in [0, 1]
+	struct BinnedTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	struct TestRange
+	{
+		const BoundingBox* boxes;
+		XMFLOAT4X4 boxToClip;
+		uint8_t* visible;
+	};
+
+	void TransformVertices(size_t occluderIndex, size_t first, size_t count);
+	void BinTriangles(size_t occluderIndex, size_t firstTriangle, size_t triangleCount, size_t binSet);
+	void BinTriangle(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c, size_t binSet);
+	void RasterizeTiles(size_t firstTile, size_t tileCount);
+	void RasterizeTriangle(const BinnedTriangle& triangle, uint32_t tileX, uint32_t tileY);
+	void RunJobs(size_t jobCount);
+	OcclusionJob* GetJob(size_t index);
+
+	XMFLOAT4X4 viewProjection;
+	std::vector<Occluder> occluders;
+	std::vector<XMFLOAT4> clipVertices;
+	// binSetCount sets of TILE_COUNT bins, set major
+	std::vector<std::vector<BinnedTriangle>> bins;
+	std::vector<uint32_t> binnedCounts;
+	size_t binSetCount = 0;
+
+	std::vector<float> depth;
+	float tileMaxDepth[TILE_COUNT];
+	TestRange testRange;
+	OcclusionStats stats;
+
+	ThreadPool& pool;
+	std::vector<std::unique_ptr<OcclusionJob>> jobs;
+	std::vector<IJob*> jobPointers;
+	JobCounter jobsCounter;
+};
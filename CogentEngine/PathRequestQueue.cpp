@@ -0,0 +1,90 @@
+#include "PathRequestQueue.h"
+
+PathRequestQueue::PathRequestQueue(ThreadPool& pool, AStar::Generator& generator)
+	: pool(pool), generator(generator)
+{
+}
+
+PathRequestQueue::~PathRequestQueue()
+{
+	// Jobs still reference this queue, let cancelled searches unwind first
+	CancelAll();
+	pool.WaitForCounter(&jobsCounter);
+}
+
+uint64_t PathRequestQueue::Request(uint32_t agentId, DirectX::XMFLOAT3 from, DirectX::XMFLOAT3 to, JobPriority priority)
+{
+	Cancel(agentId);
+
+	auto job = std::make_unique<PathFinder>();
+	job->currentPos = from;
+	job->targetPos = to;
+	job->generator = &generator;
+	job->owner = this;
+	job->agentId = agentId;
+	job->requestId = nextRequestId++;
+
+	Agent& agent = agents[agentId];
+	agent.latestRequest = job->requestId;
+	agent.current = job.get();
+
+	PathFinder* raw = job.get();
+	jobs.push_back(std::move(job));
+	pool.Enqueue(raw, &jobsCounter, priority);
+	return raw->requestId;
+}
+
+void PathRequestQueue::Cancel(uint32_t agentId)
+{
+	auto it = agents.find(agentId);
+	if (it == agents.end() || !it->second.current)
+		return;
+
+	it->second.current->token.Cancel();
+	it->second.current = nullptr;
+	cancelledCount++;
+}
+
+void PathRequestQueue::CancelAll()
+{
+	for (auto& pair : agents)
+	{
+		Cancel(pair.first);
+	}
+}
+
+bool PathRequestQueue::TryTakePath(uint32_t agentId, AStar::CoordinateList& path)
+{
+	auto it = agents.find(agentId);
+	if (it == agents.end() || !it->second.hasPath)
+		return false;
+
+	path = std::move(it->second.path);
+	it->second.hasPath = false;
+	return true;
+}
+
+void PathRequestQueue::CollectFinished()
+{
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(),
+		[](const std::unique_ptr<PathFinder>& job) { return job->isFinished; }), jobs.end());
+}
+
+void PathRequestQueue::WaitForSearches()
+{
+	pool.WaitForCounter(&jobsCounter);
+}
+
+void PathRequestQueue::OnPathFinished(PathFinder* job)
+{
+	Agent& agent = agents[job->agentId];
+	if (job->token.IsCancelled() || job->requestId != agent.latestRequest)
+	{
+		droppedCount++;
+		return;
+	}
+
+	agent.path = std::move(job->path);
+	agent.hasPath = true;
+	agent.current = nullptr;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "ThreadPool.h"
+#include "Job.h"
+
+// Runs PathFinder jobs per agent with "latest request wins". A new request
+// cancels the agent's search in flight, and results of superseded or
+// cancelled searches are dropped instead of reaching the agent.
+class PathRequestQueue
+{
+public:
+	PathRequestQueue(ThreadPool& pool, AStar::Generator& generator);
+	~PathRequestQueue();
+
+	// Returns the id of the new request, it replaces any pending one for agentId
+	uint64_t Request(uint32_t agentId, DirectX::XMFLOAT3 from, DirectX::XMFLOAT3 to, JobPriority priority = JobPriority::Background);
+	void Cancel(uint32_t agentId);
+	void CancelAll();
+
+	// Moves the newest finished path for agentId into path, if there is one
+	bool TryTakePath(uint32_t agentId, AStar::CoordinateList& path);
+
+	// Frees jobs whose callbacks have run, call once a frame before ExecuteCallbacks
+	void CollectFinished();
+
+	// Blocks until no search is running, e.g. before changing the generator's walls
+	void WaitForSearches();
+
+	// Called from PathFinder::Callback on the main thread
+	void OnPathFinished(PathFinder* job);
+
+	size_t GetInFlightCount() const { return jobs.size(); }
+	uint64_t GetCancelledCount() const { return cancelledCount; }
+	uint64_t GetDroppedCount() const { return droppedCount; }
+
+private:
+	struct Agent
+	{
+		uint64_t latestRequest = 0;
+		PathFinder* current = nullptr;
+		AStar::CoordinateList path;
+		bool hasPath = false;
+	};
+
+	ThreadPool& pool;
+	AStar::Generator& generator;
+	JobCounter jobsCounter;
+	std::unordered_map<uint32_t, Agent> agents;
+	std::vector<std::unique_ptr<PathFinder>> jobs;
+	uint64_t nextRequestId = 1;
+	uint64_t cancelledCount = 0;
+	uint64_t droppedCount = 0;
+};
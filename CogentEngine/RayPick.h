@@ -0,0 +1,20 @@
+#pragma once
+#include <DirectXCollision.h>
+
+// Ray against a picking box. DirectXCollision reports a distance of zero or
+// less when the ray starts inside the box. Such a box encloses the viewer,
+// like the level around the camera, and does not count as a hit.
+inline bool IntersectsRayAhead(const DirectX::BoundingOrientedBox& box, DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float& distance)
+{
+	return box.Intersects(origin, direction, distance) && distance > 0.0f;
+}
+
+// Point where a ray heading down meets the floor plane y = 0
+inline bool IntersectsFloor(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, DirectX::XMFLOAT3& point)
+{
+	if (DirectX::XMVectorGetY(direction) >= 0.0f)
+		return false;
+	float distance = -DirectX::XMVectorGetY(origin) / DirectX::XMVectorGetY(direction);
+	DirectX::XMStoreFloat3(&point, DirectX::XMVectorAdd(origin, DirectX::XMVectorScale(direction, distance)));
+	return true;
+}
@@ -0,0 +1,319 @@
+#include "SceneBVH.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+	float SurfaceArea(const BoundingBox& box)
+	{
+		XMFLOAT3 e = box.Extents;
+		return 8.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	float GetAxis(const XMFLOAT3& v, int axis)
+	{
+		return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+	}
+
+	BoundingBox MergeRange(const std::vector<BoundingBox>& bounds, const uint32_t* first, const uint32_t* last)
+	{
+		BoundingBox merged = bounds[*first];
+		for (const uint32_t* it = first + 1; it != last; ++it)
+		{
+			BoundingBox::CreateMerged(merged, merged, bounds[*it]);
+		}
+		return merged;
+	}
+}
+
+SceneBVH::SceneBVH(ThreadPool& pool)
+	: pool(pool)
+{
+}
+
+SceneBVH::~SceneBVH()
+{
+	WaitForRebuild();
+}
+
+void SceneBVH::SetEntities(const std::vector<Entity*>& entities)
+{
+	items = entities;
+	itemsChanged = true;
+}
+
+void SceneBVH::Add(Entity* entity)
+{
+	items.push_back(entity);
+	itemsChanged = true;
+}
+
+void SceneBVH::Remove(Entity* entity)
+{
+	auto it = std::find(items.begin(), items.end(), entity);
+	if (it == items.end())
+		return;
+
+	*it = items.back();
+	items.pop_back();
+	itemsChanged = true;
+}
+
+void SceneBVH::WaitForRebuild()
+{
+	if (rebuildInFlight)
+	{
+		pool.WaitForCounter(&rebuildCounter);
+		rebuildInFlight = false;
+	}
+}
+
+void SceneBVH::Update()
+{
+	if (itemsChanged)
+	{
+		// The in-flight result indexes the old item set, drop it
+		WaitForRebuild();
+		RebuildNow();
+		return;
+	}
+
+	if (rebuildInFlight && rebuildCounter.IsZero())
+	{
+		rebuildInFlight = false;
+		nodes.swap(rebuildNodes);
+		itemOrder.swap(rebuildOrder);
+		stats.builtCost = ComputeCost(nodes);
+		stats.backgroundRebuilds++;
+	}
+
+	Refit();
+
+	if (!rebuildInFlight && stats.cost > stats.builtCost * SCENE_BVH_REBUILD_RATIO)
+	{
+		StartBackgroundRebuild();
+	}
+}
+
+void SceneBVH::RebuildNow()
+{
+	itemBounds.resize(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		itemBounds[i] = items[i]->GetWorldAABB();
+	}
+
+	Build(itemBounds, nodes, itemOrder);
+	treeItems = items;
+	itemsChanged = false;
+	stats.itemCount = (uint32_t)items.size();
+	stats.nodeCount = (uint32_t)nodes.size();
+	stats.builtCost = stats.cost = ComputeCost(nodes);
+	stats.rebuilds++;
+}
+
+void SceneBVH::StartBackgroundRebuild()
+{
+	// Bounds keep changing while the job runs, the refit after the swap catches up
+	rebuildBounds = itemBounds;
+	rebuildInFlight = true;
+	pool.Post([this]
+	{
+		Build(rebuildBounds, rebuildNodes, rebuildOrder);
+	}, JobPriority::Background, &rebuildCounter);
+}
+
+void SceneBVH::Refit()
+{
+	if (nodes.empty())
+		return;
+
+	for (size_t i = 0; i < treeItems.size(); ++i)
+	{
+		itemBounds[i] = treeItems[i]->GetWorldAABB();
+	}
+
+	// Children are stored after their parent
+	for (size_t n = nodes.size(); n-- > 0;)
+	{
+		Node& node = nodes[n];
+		if (node.count)
+		{
+			node.bounds = MergeRange(itemBounds, &itemOrder[node.first], &itemOrder[node.first] + node.count);
+		}
+		else
+		{
+			BoundingBox::CreateMerged(node.bounds, nodes[node.first].bounds, nodes[node.first + 1].bounds);
+		}
+	}
+	stats.cost = ComputeCost(nodes);
+}
+
+float SceneBVH::ComputeCost(const std::vector<Node>& nodes)
+{
+	float cost = 0.0f;
+	for (const Node& node : nodes)
+	{
+		cost += SurfaceArea(node.bounds);
+	}
+	return cost;
+}
+
+// Top down, splitting at the median centroid along the widest centroid axis
+void SceneBVH::Build(const std::vector<BoundingBox>& bounds, std::vector<Node>& nodes, std::vector<uint32_t>& order)
+{
+	nodes.clear();
+	order.resize(bounds.size());
+	for (uint32_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	if (bounds.empty())
+		return;
+
+	nodes.reserve(2 * bounds.size());
+	nodes.push_back(Node());
+	nodes[0].first = 0;
+	nodes[0].count = (uint32_t)bounds.size();
+
+	std::vector<uint32_t> pending = { 0 };
+	while (!pending.empty())
+	{
+		uint32_t nodeIndex = pending.back();
+		pending.pop_back();
+
+		uint32_t first = nodes[nodeIndex].first;
+		uint32_t count = nodes[nodeIndex].count;
+		uint32_t* range = order.data() + first;
+		nodes[nodeIndex].bounds = MergeRange(bounds, range, range + count);
+		if (count <= SCENE_BVH_LEAF_SIZE)
+			continue;
+
+		XMFLOAT3 minCentroid(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 maxCentroid(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const XMFLOAT3& c = bounds[range[i]].Center;
+			minCentroid = XMFLOAT3(std::min(minCentroid.x, c.x), std::min(minCentroid.y, c.y), std::min(minCentroid.z, c.z));
+			maxCentroid = XMFLOAT3(std::max(maxCentroid.x, c.x), std::max(maxCentroid.y, c.y), std::max(maxCentroid.z, c.z));
+		}
+
+		int axis = 0;
+		XMFLOAT3 size(maxCentroid.x - minCentroid.x, maxCentroid.y - minCentroid.y, maxCentroid.z - minCentroid.z);
+		if (size.y > GetAxis(size, axis)) axis = 1;
+		if (size.z > GetAxis(size, axis)) axis = 2;
+
+		uint32_t half = count / 2;
+		std::nth_element(range, range + half, range + count, [&bounds, axis](uint32_t a, uint32_t b)
+		{
+			return GetAxis(bounds[a].Center, axis) < GetAxis(bounds[b].Center, axis);
+		});
+
+		uint32_t left = (uint32_t)nodes.size();
+		nodes.push_back(Node());
+		nodes.push_back(Node());
+		nodes[left].first = first;
+		nodes[left].count = half;
+		nodes[left + 1].first = first + half;
+		nodes[left + 1].count = count - half;
+		nodes[nodeIndex].first = left;
+		nodes[nodeIndex].count = 0;
+		pending.push_back(left);
+		pending.push_back(left + 1);
+	}
+}
+
+Entity* SceneBVH::RayCast(FXMVECTOR origin, FXMVECTOR direction, float& distance) const
+{
+	Entity* nearest = nullptr;
+	distance = FLT_MAX;
+	if (nodes.empty())
+		return nullptr;
+
+	float rootDistance;
+	if (!nodes[0].bounds.Intersects(origin, direction, rootDistance))
+		return nullptr;
+
+	// Nearer child is visited first, nodes starting past the best hit are skipped
+	struct Entry { uint32_t node; float distance; };
+	Entry stack[64];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, rootDistance };
+	while (stackSize)
+	{
+		Entry entry = stack[--stackSize];
+		if (entry.distance >= distance)
+			continue;
+
+		const Node& node = nodes[entry.node];
+		if (node.count)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				uint32_t item = itemOrder[i];
+				float boxDistance;
+				if (!itemBounds[item].Intersects(origin, direction, boxDistance) || boxDistance >= distance)
+					continue;
+
+				float hitDistance;
+				if (IntersectsRayAhead(treeItems[item]->GetWorldBounds(), origin, direction, hitDistance) && hitDistance < distance)
+				{
+					distance = hitDistance;
+					nearest = treeItems[item];
+				}
+			}
+			continue;
+		}
+
+		float leftDistance, rightDistance;
+		bool hitLeft = nodes[node.first].bounds.Intersects(origin, direction, leftDistance);
+		bool hitRight = nodes[node.first + 1].bounds.Intersects(origin, direction, rightDistance);
+		if (hitLeft && hitRight)
+		{
+			bool leftFirst = leftDistance <= rightDistance;
+			stack[stackSize++] = leftFirst ? Entry{ node.first + 1, rightDistance } : Entry{ node.first, leftDistance };
+			stack[stackSize++] = leftFirst ? Entry{ node.first, leftDistance } : Entry{ node.first + 1, rightDistance };
+		}
+		else if (hitLeft)
+		{
+			stack[stackSize++] = { node.first, leftDistance };
+		}
+		else if (hitRight)
+		{
+			stack[stackSize++] = { node.first + 1, rightDistance };
+		}
+	}
+
+	return nearest;
+}
+
+void SceneBVH::AppendSubtree(uint32_t nodeIndex, std::vector<Entity*>& result) const
+{
+	const Node& node = nodes[nodeIndex];
+	if (node.count)
+	{
+		for (uint32_t i = node.first; i < node.first + node.count; ++i)
+		{
+			result.push_back(treeItems[itemOrder[i]]);
+		}
+		return;
+	}
+
+	AppendSubtree(node.first, result);
+	AppendSubtree(node.first + 1, result);
+}
+
+void SceneBVH::Query(const BoundingFrustum& frustum, std::vector<Entity*>& result) const
+{
+	QueryShape(frustum, result);
+}
+
+void SceneBVH::Query(const BoundingBox& box, std::vector<Entity*>& result) const
+{
+	QueryShape(box, result);
+}
+
+void SceneBVH::Query(const BoundingSphere& sphere, std::vector<Entity*>& result) const
+{
+	QueryShape(sphere, result);
+}
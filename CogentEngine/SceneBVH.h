@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "Constants.h"
+#include "Entity.h"
+#include "ThreadPool.h"
+#include "JobCounter.h"
+#include "RayPick.h"
+
+using namespace DirectX;
+
+struct SceneBVHStats
+{
+	uint32_t itemCount = 0;
+	uint32_t nodeCount = 0;
+	uint32_t rebuilds = 0;
+	uint32_t backgroundRebuilds = 0;
+	// Summed surface area of the node boxes now and right after the last build
+	float cost = 0.0f;
+	float builtCost = 0.0f;
+};
+
+// Bounding volume hierarchy over entity world AABBs. Nodes live in one array
+// with both children of a node next to each other and after their parent.
+// Moving entities only refits the boxes bottom up. Once refitting has made
+// the tree noticeably worse than it was when built, a new tree is built from
+// a snapshot of the bounds on a background worker and swapped in when done.
+// All methods are main thread only.
+class SceneBVH
+{
+public:
+	SceneBVH(ThreadPool& pool);
+	~SceneBVH();
+
+	// Item changes take effect on the next Update, until then queries still
+	// see the old set
+	void SetEntities(const std::vector<Entity*>& entities);
+	void Add(Entity* entity);
+	void Remove(Entity* entity);
+
+	// Call once a frame after world bounds are up to date
+	void Update();
+
+	// Nearest entity whose world oriented box the ray hits, null if none.
+	// Boxes the ray starts in are skipped. direction must be normalized.
+	Entity* RayCast(FXMVECTOR origin, FXMVECTOR direction, float& distance) const;
+	// Entities whose world AABB intersects the volume, appended to result
+	void Query(const BoundingFrustum& frustum, std::vector<Entity*>& result) const;
+	void Query(const BoundingBox& box, std::vector<Entity*>& result) const;
+	void Query(const BoundingSphere& sphere, std::vector<Entity*>& result) const;
+
+	const SceneBVHStats& GetStats() const { return stats; }
+
+private:
+	struct Node
+	{
+		BoundingBox bounds;
+		// Leaf: items [first, first + count) of itemOrder. Inner: count is 0
+		// and the children are nodes first and first + 1.
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	static void Build(const std::vector<BoundingBox>& bounds, std::vector<Node>& nodes, std::vector<uint32_t>& order);
+	static float ComputeCost(const std::vector<Node>& nodes);
+	void Refit();
+	void RebuildNow();
+	void StartBackgroundRebuild();
+	void WaitForRebuild();
+
+	template<typename Shape>
+	void QueryShape(const Shape& shape, std::vector<Entity*>& result) const;
+	void AppendSubtree(uint32_t nodeIndex, std::vector<Entity*>& result) const;
+
+	ThreadPool& pool;
+	std::vector<Entity*> items;
+	// Items the current tree was built over
+	std::vector<Entity*> treeItems;
+	std::vector<BoundingBox> itemBounds;
+	std::vector<Node> nodes;
+	std::vector<uint32_t> itemOrder;
+	bool itemsChanged = false;
+	SceneBVHStats stats;
+
+	// Background rebuild, the snapshot and results are only touched by the
+	// job while rebuildCounter is non zero
+	JobCounter rebuildCounter;
+	bool rebuildInFlight = false;
+	std::vector<BoundingBox> rebuildBounds;
+	std::vector<Node> rebuildNodes;
+	std::vector<uint32_t> rebuildOrder;
+};
+
+template<typename Shape>
+inline void SceneBVH::QueryShape(const Shape& shape, std::vector<Entity*>& result) const
+{
+	if (nodes.empty())
+		return;
+
+	uint32_t stack[64];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		ContainmentType containment = shape.Contains(node.bounds);
+		if (containment == DISJOINT)
+			continue;
+
+		// Everything below is inside, no more tests needed
+		if (containment == CONTAINS)
+		{
+			AppendSubtree((uint32_t)(&node - nodes.data()), result);
+			continue;
+		}
+
+		if (node.count)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; ++i)
+			{
+				if (shape.Intersects(itemBounds[itemOrder[i]]))
+				{
+					result.push_back(treeItems[itemOrder[i]]);
+				}
+			}
+			continue;
+		}
+
+		stack[stackSize++] = node.first;
+		stack[stackSize++] = node.first + 1;
+	}
+}
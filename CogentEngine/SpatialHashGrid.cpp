@@ -0,0 +1,294 @@
+#include "SpatialHashGrid.h"
+#include "Job.h"
+#include <cmath>
+
+SpatialHashGrid::SpatialHashGrid(ThreadPool& pool, float cellSize)
+	: pool(pool), cellSize(cellSize), inverseCellSize(1.0f / cellSize)
+{
+}
+
+SpatialHashGrid::~SpatialHashGrid()
+{
+}
+
+SpatialHashGrid::CellCoord SpatialHashGrid::GetCell(const XMFLOAT3& position) const
+{
+	return { (int32_t)floorf(position.x * inverseCellSize), (int32_t)floorf(position.y * inverseCellSize), (int32_t)floorf(position.z * inverseCellSize) };
+}
+
+// 21 bits per axis, so keys only repeat in worlds two million cells across
+uint64_t SpatialHashGrid::GetKey(const CellCoord& cell)
+{
+	const uint64_t mask = (1 << 21) - 1;
+	return ((uint64_t)cell.x & mask) | (((uint64_t)cell.y & mask) << 21) | (((uint64_t)cell.z & mask) << 42);
+}
+
+XMFLOAT3 SpatialHashGrid::GetPosition(Entity* entity) const
+{
+	// World translation, so parented entities land where they are drawn
+	XMFLOAT4X4 world = entity->GetWorldMatrix();
+	return XMFLOAT3(world._14, world._24, world._34);
+}
+
+void SpatialHashGrid::AddToCell(uint32_t item, uint64_t key)
+{
+	auto& cell = cells[key];
+	itemCells[item] = key;
+	cellSlots[item] = (uint32_t)cell.size();
+	cell.push_back(item);
+}
+
+void SpatialHashGrid::RemoveFromCell(uint32_t item)
+{
+	auto cell = cells.find(itemCells[item]);
+	auto& cellItems = cell->second;
+	uint32_t slot = cellSlots[item];
+	uint32_t moved = cellItems.back();
+	cellItems[slot] = moved;
+	cellSlots[moved] = slot;
+	cellItems.pop_back();
+	if (cellItems.empty())
+	{
+		cells.erase(cell);
+	}
+}
+
+void SpatialHashGrid::Insert(Entity* entity)
+{
+	if (itemIndices.count(entity))
+		return;
+
+	uint32_t item = (uint32_t)items.size();
+	itemIndices[entity] = item;
+	items.push_back(entity);
+	positions.push_back(GetPosition(entity));
+	itemCells.push_back(0);
+	cellSlots.push_back(0);
+
+	CellCoord cell = GetCell(positions[item]);
+	AddToCell(item, GetKey(cell));
+	if (items.size() == 1)
+	{
+		occupiedMin = occupiedMax = cell;
+	}
+	else
+	{
+		occupiedMin = { std::min(occupiedMin.x, cell.x), std::min(occupiedMin.y, cell.y), std::min(occupiedMin.z, cell.z) };
+		occupiedMax = { std::max(occupiedMax.x, cell.x), std::max(occupiedMax.y, cell.y), std::max(occupiedMax.z, cell.z) };
+	}
+}
+
+void SpatialHashGrid::Remove(Entity* entity)
+{
+	auto found = itemIndices.find(entity);
+	if (found == itemIndices.end())
+		return;
+
+	uint32_t item = found->second;
+	itemIndices.erase(found);
+	RemoveFromCell(item);
+
+	// Fill the hole with the last item, its cell list refers to it by index
+	uint32_t last = (uint32_t)items.size() - 1;
+	if (item != last)
+	{
+		items[item] = items[last];
+		positions[item] = positions[last];
+		itemCells[item] = itemCells[last];
+		cellSlots[item] = cellSlots[last];
+		cells[itemCells[item]][cellSlots[item]] = item;
+		itemIndices[items[item]] = item;
+	}
+	items.pop_back();
+	positions.pop_back();
+	itemCells.pop_back();
+	cellSlots.pop_back();
+}
+
+void SpatialHashGrid::Update()
+{
+	lastUpdateMoveCount = 0;
+	for (uint32_t item = 0; item < items.size(); ++item)
+	{
+		positions[item] = GetPosition(items[item]);
+		uint64_t key = GetKey(GetCell(positions[item]));
+		if (key != itemCells[item])
+		{
+			RemoveFromCell(item);
+			AddToCell(item, key);
+			lastUpdateMoveCount++;
+		}
+	}
+
+	UpdateOccupiedBounds();
+}
+
+void SpatialHashGrid::UpdateOccupiedBounds()
+{
+	if (items.empty())
+	{
+		occupiedMin = { 0, 0, 0 };
+		occupiedMax = { -1, -1, -1 };
+		return;
+	}
+
+	occupiedMin = occupiedMax = GetCell(positions[0]);
+	for (const XMFLOAT3& position : positions)
+	{
+		CellCoord cell = GetCell(position);
+		occupiedMin = { std::min(occupiedMin.x, cell.x), std::min(occupiedMin.y, cell.y), std::min(occupiedMin.z, cell.z) };
+		occupiedMax = { std::max(occupiedMax.x, cell.x), std::max(occupiedMax.y, cell.y), std::max(occupiedMax.z, cell.z) };
+	}
+}
+
+void SpatialHashGrid::QueryRadius(const XMFLOAT3& center, float radius, std::vector<Entity*>& result) const
+{
+	float radiusSquared = radius * radius;
+	CellCoord first = GetCell(XMFLOAT3(center.x - radius, center.y - radius, center.z - radius));
+	CellCoord last = GetCell(XMFLOAT3(center.x + radius, center.y + radius, center.z + radius));
+	ForEachInCells(first, last, [&](uint32_t item)
+	{
+		const XMFLOAT3& p = positions[item];
+		float dx = p.x - center.x, dy = p.y - center.y, dz = p.z - center.z;
+		if (dx * dx + dy * dy + dz * dz <= radiusSquared)
+		{
+			result.push_back(items[item]);
+		}
+	});
+}
+
+void SpatialHashGrid::QueryBox(const BoundingBox& box, std::vector<Entity*>& result) const
+{
+	XMFLOAT3 minimum(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+	XMFLOAT3 maximum(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+	ForEachInCells(GetCell(minimum), GetCell(maximum), [&](uint32_t item)
+	{
+		const XMFLOAT3& p = positions[item];
+		if (p.x >= minimum.x && p.x <= maximum.x && p.y >= minimum.y && p.y <= maximum.y && p.z >= minimum.z && p.z <= maximum.z)
+		{
+			result.push_back(items[item]);
+		}
+	});
+}
+
+size_t SpatialHashGrid::QueryNearest(const XMFLOAT3& point, size_t count, std::vector<Entity*>& result, float maxRadius) const
+{
+	if (count == 0 || items.empty())
+		return 0;
+
+	// Max heap of the best candidates so far, by squared distance
+	std::vector<std::pair<float, uint32_t>> best;
+	best.reserve(count + 1);
+	float maxRadiusSquared = maxRadius < FLT_MAX ? maxRadius * maxRadius : FLT_MAX;
+	auto consider = [&](uint32_t item)
+	{
+		const XMFLOAT3& p = positions[item];
+		float dx = p.x - point.x, dy = p.y - point.y, dz = p.z - point.z;
+		float distanceSquared = dx * dx + dy * dy + dz * dz;
+		if (distanceSquared > maxRadiusSquared || (best.size() == count && distanceSquared >= best.front().first))
+			return;
+
+		best.push_back({ distanceSquared, item });
+		std::push_heap(best.begin(), best.end());
+		if (best.size() > count)
+		{
+			std::pop_heap(best.begin(), best.end());
+			best.pop_back();
+		}
+	};
+
+	// Rings of cells around the point's cell. Ring r is at least (r - 1)
+	// cells away, so the search ends once that is farther than the worst kept.
+	CellCoord center = GetCell(point);
+	int32_t maxRing = std::max({ std::abs(center.x - occupiedMin.x), std::abs(center.x - occupiedMax.x),
+		std::abs(center.y - occupiedMin.y), std::abs(center.y - occupiedMax.y),
+		std::abs(center.z - occupiedMin.z), std::abs(center.z - occupiedMax.z) });
+	for (int32_t ring = 0; ring <= maxRing; ++ring)
+	{
+		float ringDistance = std::max(0, ring - 1) * cellSize;
+		if (ringDistance > maxRadius)
+			break;
+		if (best.size() == count && best.front().first <= ringDistance * ringDistance)
+			break;
+
+		CellCoord first = { center.x - ring, center.y - ring, center.z - ring };
+		CellCoord last = { center.x + ring, center.y + ring, center.z + ring };
+		for (int32_t z = first.z; z <= last.z; ++z)
+		{
+			bool zEdge = z == first.z || z == last.z;
+			for (int32_t y = first.y; y <= last.y; ++y)
+			{
+				bool yEdge = zEdge || y == first.y || y == last.y;
+				// Inside the shell only the two end cells of the row are on the ring
+				int32_t step = yEdge ? 1 : std::max(1, last.x - first.x);
+				for (int32_t x = first.x; x <= last.x; x += step)
+				{
+					if (x < occupiedMin.x || x > occupiedMax.x || y < occupiedMin.y || y > occupiedMax.y || z < occupiedMin.z || z > occupiedMax.z)
+						continue;
+
+					auto cell = cells.find(GetKey({ x, y, z }));
+					if (cell == cells.end())
+						continue;
+
+					for (uint32_t item : cell->second)
+					{
+						consider(item);
+					}
+				}
+			}
+		}
+	}
+
+	std::sort_heap(best.begin(), best.end());
+	for (auto& candidate : best)
+	{
+		result.push_back(items[candidate.second]);
+	}
+	return best.size();
+}
+
+void SpatialHashGrid::RunQueries(SpatialQuery* queries, size_t count) const
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		SpatialQuery& query = queries[i];
+		query.results.clear();
+		if (query.nearestCount)
+		{
+			QueryNearest(query.center, query.nearestCount, query.results, query.radius);
+		}
+		else
+		{
+			QueryRadius(query.center, query.radius, query.results);
+		}
+	}
+}
+
+void SpatialHashGrid::QueryBatch(std::vector<SpatialQuery>& queries)
+{
+	size_t batchCount = (queries.size() + SPATIAL_QUERY_BATCH_SIZE - 1) / SPATIAL_QUERY_BATCH_SIZE;
+	if (batchCount <= 1)
+	{
+		RunQueries(queries.data(), queries.size());
+		return;
+	}
+
+	while (jobs.size() < batchCount)
+	{
+		jobs.push_back(std::make_unique<SpatialQueryJob>());
+	}
+
+	jobPointers.clear();
+	for (size_t b = 0; b < batchCount; ++b)
+	{
+		auto job = jobs[b].get();
+		size_t first = b * SPATIAL_QUERY_BATCH_SIZE;
+		job->grid = this;
+		job->queries = queries.data() + first;
+		job->count = std::min((size_t)SPATIAL_QUERY_BATCH_SIZE, queries.size() - first);
+		jobPointers.push_back(job);
+	}
+
+	pool.EnqueueBatch(jobPointers, &jobsCounter, JobPriority::Critical);
+	pool.WaitForCounter(&jobsCounter);
+}
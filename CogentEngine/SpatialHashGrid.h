@@ -0,0 +1,146 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "Constants.h"
+#include "Entity.h"
+#include "ThreadPool.h"
+#include "JobCounter.h"
+
+using namespace DirectX;
+
+class SpatialQueryJob;
+
+// One query of a parallel batch. With nearestCount set the results are the
+// nearest entities within radius, nearest first, otherwise every entity
+// within radius.
+struct SpatialQuery
+{
+	XMFLOAT3 center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	float radius = FLT_MAX;
+	uint32_t nearestCount = 0;
+	std::vector<Entity*> results;
+};
+
+// Uniform grid over entity world positions, hashed so only occupied cells
+// cost memory. Update re-reads the positions and moves only the entities
+// that changed cell. Queries visit the cells overlapping the query volume.
+//
+// Insert, Remove and Update are main thread only. Queries only read, so any
+// number may run at once while nothing modifies the grid.
+class SpatialHashGrid
+{
+public:
+	SpatialHashGrid(ThreadPool& pool, float cellSize);
+	~SpatialHashGrid();
+
+	void Insert(Entity* entity);
+	void Remove(Entity* entity);
+	// Call once a frame after world matrices are up to date
+	void Update();
+
+	// Entities whose position is inside the volume, appended to result
+	void QueryRadius(const XMFLOAT3& center, float radius, std::vector<Entity*>& result) const;
+	void QueryBox(const BoundingBox& box, std::vector<Entity*>& result) const;
+	// Up to count entities nearest to point and within maxRadius, appended
+	// nearest first. Returns how many were found.
+	size_t QueryNearest(const XMFLOAT3& point, size_t count, std::vector<Entity*>& result, float maxRadius = FLT_MAX) const;
+
+	// Runs the queries in jobs of SPATIAL_QUERY_BATCH_SIZE and waits
+	void QueryBatch(std::vector<SpatialQuery>& queries);
+	void RunQueries(SpatialQuery* queries, size_t count) const;
+
+	size_t GetCount() const { return items.size(); }
+	size_t GetCellCount() const { return cells.size(); }
+	// Entities that changed cell in the last Update
+	uint32_t GetLastUpdateMoveCount() const { return lastUpdateMoveCount; }
+
+private:
+	struct CellCoord
+	{
+		int32_t x, y, z;
+	};
+
+	CellCoord GetCell(const XMFLOAT3& position) const;
+	static uint64_t GetKey(const CellCoord& cell);
+	XMFLOAT3 GetPosition(Entity* entity) const;
+	void AddToCell(uint32_t item, uint64_t key);
+	void RemoveFromCell(uint32_t item);
+	void UpdateOccupiedBounds();
+
+	// Calls visit(item) for every item in the cells [first, last], clamped
+	// to the occupied cells
+	template<typename Visit>
+	void ForEachInCells(CellCoord first, CellCoord last, Visit&& visit) const;
+
+	float cellSize;
+	float inverseCellSize;
+
+	// Per item, swap removed
+	std::vector<Entity*> items;
+	std::vector<XMFLOAT3> positions;
+	std::vector<uint64_t> itemCells;
+	// Index of the item in its cell's list
+	std::vector<uint32_t> cellSlots;
+	std::unordered_map<Entity*, uint32_t> itemIndices;
+
+	std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+	CellCoord occupiedMin = { 0, 0, 0 };
+	CellCoord occupiedMax = { -1, -1, -1 };
+	uint32_t lastUpdateMoveCount = 0;
+
+	ThreadPool& pool;
+	std::vector<std::unique_ptr<SpatialQueryJob>> jobs;
+	std::vector<IJob*> jobPointers;
+	JobCounter jobsCounter;
+};
+
+template<typename Visit>
+inline void SpatialHashGrid::ForEachInCells(CellCoord first, CellCoord last, Visit&& visit) const
+{
+	first = { std::max(first.x, occupiedMin.x), std::max(first.y, occupiedMin.y), std::max(first.z, occupiedMin.z) };
+	last = { std::min(last.x, occupiedMax.x), std::min(last.y, occupiedMax.y), std::min(last.z, occupiedMax.z) };
+	if (first.x > last.x || first.y > last.y || first.z > last.z)
+		return;
+
+	// Walking the occupied cells is cheaper than probing a mostly empty range
+	int64_t rangeCells = int64_t(last.x - first.x + 1) * (last.y - first.y + 1) * (last.z - first.z + 1);
+	if (rangeCells > (int64_t)cells.size())
+	{
+		for (auto& cell : cells)
+		{
+			for (uint32_t item : cell.second)
+			{
+				CellCoord coord = GetCell(positions[item]);
+				if (coord.x >= first.x && coord.x <= last.x && coord.y >= first.y && coord.y <= last.y && coord.z >= first.z && coord.z <= last.z)
+				{
+					visit(item);
+				}
+			}
+		}
+		return;
+	}
+
+	for (int32_t z = first.z; z <= last.z; ++z)
+	{
+		for (int32_t y = first.y; y <= last.y; ++y)
+		{
+			for (int32_t x = first.x; x <= last.x; ++x)
+			{
+				auto cell = cells.find(GetKey({ x, y, z }));
+				if (cell == cells.end())
+					continue;
+
+				for (uint32_t item : cell->second)
+				{
+					visit(item);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <thread>
+using namespace std;
+
+// Bounded queue for exactly one producer thread and one consumer thread, e.g.
+// the main thread feeding a loader thread. Unlike ConcurrentQueue it takes no
+// lock: TryPush/TryPop and the bulk versions are wait-free, and each side
+// keeps a cached copy of the other side's index so the shared cache line is
+// only touched when the cached view says the ring is full or empty.
+template <typename T>
+class SpscRing
+{
+public:
+	// Capacity is rounded up to a power of two
+	explicit SpscRing(size_t capacity);
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// Producer side
+	bool TryPush(const T& item);
+	bool TryPush(T&& item);
+	// Copies as many items as fit, returns how many were pushed
+	size_t TryPushBulk(span<const T> items);
+	// Spins, then yields, while the ring is full
+	void Push(T item);
+
+	// Consumer side
+	bool TryPop(T& item);
+	// Moves up to out.size() items into out, returns how many were popped
+	size_t TryPopBulk(span<T> out);
+	// Spins, then yields, while the ring is empty
+	T Pop();
+
+	// Exact only when called from one of the two sides while the other is idle
+	size_t GetSize() const;
+	bool IsEmpty() const { return GetSize() == 0; }
+	size_t GetCapacity() const { return mask + 1; }
+
+private:
+	static constexpr size_t CacheLineSize = 64;
+	static constexpr int SpinsBeforeYield = 64;
+
+	static size_t RoundUpToPowerOfTwo(size_t value);
+	size_t FreeSlots();
+	size_t ReadySlots();
+
+	unique_ptr<T[]> slots;
+	size_t mask;
+
+	// Written by the consumer
+	alignas(CacheLineSize) atomic<size_t> head{ 0 };
+	size_t cachedTail = 0;
+
+	// Written by the producer
+	alignas(CacheLineSize) atomic<size_t> tail{ 0 };
+	size_t cachedHead = 0;
+
+	char padding[CacheLineSize - sizeof(atomic<size_t>) - sizeof(size_t)];
+};
+
+template<typename T>
+SpscRing<T>::SpscRing(size_t capacity)
+	: slots(new T[RoundUpToPowerOfTwo(capacity)]), mask(RoundUpToPowerOfTwo(capacity) - 1)
+{
+}
+
+template<typename T>
+size_t SpscRing<T>::RoundUpToPowerOfTwo(size_t value)
+{
+	size_t result = 2;
+	while (result < value)
+	{
+		result <<= 1;
+	}
+	return result;
+}
+
+template<typename T>
+size_t SpscRing<T>::FreeSlots()
+{
+	size_t currentTail = tail.load(memory_order_relaxed);
+	size_t free = GetCapacity() - (currentTail - cachedHead);
+	if (free == 0)
+	{
+		cachedHead = head.load(memory_order_acquire);
+		free = GetCapacity() - (currentTail - cachedHead);
+	}
+	return free;
+}
+
+template<typename T>
+size_t SpscRing<T>::ReadySlots()
+{
+	size_t currentHead = head.load(memory_order_relaxed);
+	size_t ready = cachedTail - currentHead;
+	if (ready == 0)
+	{
+		cachedTail = tail.load(memory_order_acquire);
+		ready = cachedTail - currentHead;
+	}
+	return ready;
+}
+
+template<typename T>
+bool SpscRing<T>::TryPush(const T& item)
+{
+	if (FreeSlots() == 0)
+		return false;
+
+	size_t currentTail = tail.load(memory_order_relaxed);
+	slots[currentTail & mask] = item;
+	tail.store(currentTail + 1, memory_order_release);
+	return true;
+}
+
+template<typename T>
+bool SpscRing<T>::TryPush(T&& item)
+{
+	if (FreeSlots() == 0)
+		return false;
+
+	size_t currentTail = tail.load(memory_order_relaxed);
+	slots[currentTail & mask] = move(item);
+	tail.store(currentTail + 1, memory_order_release);
+	return true;
+}
+
+template<typename T>
+size_t SpscRing<T>::TryPushBulk(span<const T> items)
+{
+	size_t count = min(items.size(), FreeSlots());
+	size_t currentTail = tail.load(memory_order_relaxed);
+	for (size_t i = 0; i < count; ++i)
+	{
+		slots[(currentTail + i) & mask] = items[i];
+	}
+	// One release publishes the whole run
+	tail.store(currentTail + count, memory_order_release);
+	return count;
+}
+
+template<typename T>
+void SpscRing<T>::Push(T item)
+{
+	for (int spins = 0; !TryPush(move(item)); ++spins)
+	{
+		if (spins >= SpinsBeforeYield)
+			this_thread::yield();
+	}
+}
+
+template<typename T>
+bool SpscRing<T>::TryPop(T& item)
+{
+	if (ReadySlots() == 0)
+		return false;
+
+	size_t currentHead = head.load(memory_order_relaxed);
+	item = move(slots[currentHead & mask]);
+	head.store(currentHead + 1, memory_order_release);
+	return true;
+}
+
+template<typename T>
+size_t SpscRing<T>::TryPopBulk(span<T> out)
+{
+	size_t count = min(out.size(), ReadySlots());
+	size_t currentHead = head.load(memory_order_relaxed);
+	for (size_t i = 0; i < count; ++i)
+	{
+		out[i] = move(slots[(currentHead + i) & mask]);
+	}
+	head.store(currentHead + count, memory_order_release);
+	return count;
+}
+
+template<typename T>
+T SpscRing<T>::Pop()
+{
+	T item;
+	for (int spins = 0; !TryPop(item); ++spins)
+	{
+		if (spins >= SpinsBeforeYield)
+			this_thread::yield();
+	}
+	return item;
+}
+
+template<typename T>
+size_t SpscRing<T>::GetSize() const
+{
+	return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+}
@@ -0,0 +1,112 @@
+#include "SystemScheduler.h"
+#include "Job.h"
+#include <cstdio>
+
+SystemScheduler::SystemScheduler(ThreadPool& pool, EcsWorld& world)
+	: pool(pool)
+	, world(world)
+{
+}
+
+SystemScheduler::~SystemScheduler()
+{
+}
+
+void SystemScheduler::AddSystem(const string& name, ComponentMask reads, ComponentMask writes, function<void(EcsWorld&)> run)
+{
+	systems.push_back({ name, reads, writes, move(run) });
+	phasesDirty = true;
+}
+
+bool SystemScheduler::Conflicts(const SystemDesc& a, const SystemDesc& b)
+{
+	return (a.writes & (b.reads | b.writes)) || (b.writes & a.reads);
+}
+
+void SystemScheduler::BuildPhases()
+{
+	phases.clear();
+	vector<size_t> systemPhases(systems.size(), 0);
+	for (size_t i = 0; i < systems.size(); ++i)
+	{
+		size_t phase = 0;
+		for (size_t j = 0; j < i; ++j)
+		{
+			if (Conflicts(systems[i], systems[j]))
+			{
+				phase = max(phase, systemPhases[j] + 1);
+			}
+		}
+
+		systemPhases[i] = phase;
+		if (phases.size() <= phase)
+		{
+			phases.resize(phase + 1);
+		}
+		phases[phase].push_back(i);
+	}
+
+	while (jobs.size() < systems.size())
+	{
+		jobs.push_back(make_unique<SystemJob>());
+	}
+	phasesDirty = false;
+}
+
+size_t SystemScheduler::GetPhaseCount()
+{
+	if (phasesDirty)
+	{
+		BuildPhases();
+	}
+	return phases.size();
+}
+
+void SystemScheduler::Run()
+{
+	if (phasesDirty)
+	{
+		BuildPhases();
+	}
+
+	for (auto& phase : phases)
+	{
+		// Not worth a round trip through the queues
+		if (phase.size() == 1)
+		{
+			RunSystem(phase[0]);
+			continue;
+		}
+
+		jobPointers.clear();
+		for (size_t index : phase)
+		{
+			auto job = jobs[index].get();
+			job->scheduler = this;
+			job->systemIndex = index;
+			job->name = systems[index].name.c_str();
+			jobPointers.push_back(job);
+		}
+
+		pool.EnqueueBatch(jobPointers, &counter, JobPriority::Critical);
+		pool.WaitForCounter(&counter);
+	}
+}
+
+void SystemScheduler::RunSystem(size_t index)
+{
+	systems[index].run(world);
+}
+
+void SystemScheduler::PrintPhases()
+{
+	for (size_t phase = 0; phase < GetPhaseCount(); ++phase)
+	{
+		printf("Phase %zu:", phase);
+		for (size_t index : phases[phase])
+		{
+			printf(" %s", systems[index].name.c_str());
+		}
+		printf("\n");
+	}
+}
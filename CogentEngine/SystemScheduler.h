@@ -0,0 +1,61 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "EcsWorld.h"
+#include "ThreadPool.h"
+#include "JobCounter.h"
+
+using namespace std;
+
+class SystemJob;
+
+struct SystemDesc
+{
+	string name;
+	// Component types the system reads and writes, see EcsWorld::MaskOf
+	ComponentMask reads = 0;
+	ComponentMask writes = 0;
+	function<void(EcsWorld&)> run;
+};
+
+// Runs ECS systems on the job system. Systems are grouped into phases: a
+// system goes into the phase after the last earlier system it conflicts
+// with, two systems conflicting when one writes a component the other reads
+// or writes. Systems of one phase run in parallel, phases run in order, so
+// the result matches running the systems one by one in registration order.
+// Systems may only change component data, never add or remove entities or
+// components, and must not touch state outside the components they declare.
+class SystemScheduler
+{
+public:
+	SystemScheduler(ThreadPool& pool, EcsWorld& world);
+	~SystemScheduler();
+
+	void AddSystem(const string& name, ComponentMask reads, ComponentMask writes, function<void(EcsWorld&)> run);
+
+	// Runs every system once and returns when all are done
+	void Run();
+	void RunSystem(size_t index);
+
+	size_t GetSystemCount() const { return systems.size(); }
+	size_t GetPhaseCount();
+	// Prints each phase and its systems
+	void PrintPhases();
+
+private:
+	static bool Conflicts(const SystemDesc& a, const SystemDesc& b);
+	void BuildPhases();
+
+	ThreadPool& pool;
+	EcsWorld& world;
+	vector<SystemDesc> systems;
+	// System indices per phase
+	vector<vector<size_t>> phases;
+	bool phasesDirty = false;
+
+	vector<unique_ptr<SystemJob>> jobs;
+	vector<IJob*> jobPointers;
+	JobCounter counter;
+};
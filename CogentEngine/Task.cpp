@@ -0,0 +1,72 @@
+#include "Task.h"
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+	constexpr size_t MinFrameSize = 64;
+	constexpr size_t SizeClassCount = 8;	// 64 bytes .. 8 KB
+
+	struct FreeList
+	{
+		std::mutex mtx;
+		std::vector<void*> frames;
+	};
+
+	// Never destroyed, a frame may be freed from another static's destructor
+	// after this one would have run
+	FreeList* GetFreeLists()
+	{
+		static FreeList* freeLists = new FreeList[SizeClassCount];
+		return freeLists;
+	}
+
+	// Returns SizeClassCount for frames too large to pool
+	size_t GetSizeClass(size_t size)
+	{
+		size_t sizeClass = 0;
+		size_t classSize = MinFrameSize;
+		while (classSize < size && sizeClass < SizeClassCount)
+		{
+			classSize <<= 1;
+			sizeClass++;
+		}
+		return sizeClass;
+	}
+}
+
+void* CoroutineFrameAllocator::Allocate(size_t size)
+{
+	auto sizeClass = GetSizeClass(size);
+	if (sizeClass == SizeClassCount)
+	{
+		return ::operator new(size);
+	}
+
+	auto& freeList = GetFreeLists()[sizeClass];
+	{
+		std::lock_guard<std::mutex> lock{ freeList.mtx };
+		if (!freeList.frames.empty())
+		{
+			auto frame = freeList.frames.back();
+			freeList.frames.pop_back();
+			return frame;
+		}
+	}
+	return ::operator new(MinFrameSize << sizeClass);
+}
+
+void CoroutineFrameAllocator::Free(void* pointer, size_t size)
+{
+	auto sizeClass = GetSizeClass(size);
+	if (sizeClass == SizeClassCount)
+	{
+		::operator delete(pointer);
+		return;
+	}
+
+	auto& freeList = GetFreeLists()[sizeClass];
+	std::lock_guard<std::mutex> lock{ freeList.mtx };
+	freeList.frames.push_back(pointer);
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Recycles coroutine frames in power-of-two size classes so suspending
+// pipelines don't hit the global heap for every step.
+class CoroutineFrameAllocator
+{
+public:
+	static void* Allocate(size_t size);
+	static void Free(void* pointer, size_t size);
+};
+
+template<typename T>
+class Task;
+
+namespace TaskDetail
+{
+	struct PromiseBase
+	{
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+		std::atomic<bool> isDone{ false };
+
+		// Tasks are lazy, nothing runs until they are awaited or started
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+			void await_resume() noexcept {}
+
+			// Resume the awaiting coroutine right here, no extra thread hop
+			template<typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+			{
+				auto& promise = handle.promise();
+				auto continuation = promise.continuation;
+				promise.isDone.store(true, std::memory_order_release);
+				if (continuation)
+				{
+					return continuation;
+				}
+				return std::noop_coroutine();
+			}
+		};
+
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void unhandled_exception() { exception = std::current_exception(); }
+
+		static void* operator new(size_t size) { return CoroutineFrameAllocator::Allocate(size); }
+		static void operator delete(void* pointer, size_t size) { CoroutineFrameAllocator::Free(pointer, size); }
+	};
+
+	template<typename T>
+	struct Promise : PromiseBase
+	{
+		std::optional<T> value;
+
+		Task<T> get_return_object();
+		void return_value(T result) { value = std::move(result); }
+
+		T TakeResult()
+		{
+			if (exception)
+			{
+				std::rethrow_exception(exception);
+			}
+			return std::move(*value);
+		}
+	};
+
+	template<>
+	struct Promise<void> : PromiseBase
+	{
+		Task<void> get_return_object();
+		void return_void() {}
+
+		void TakeResult()
+		{
+			if (exception)
+			{
+				std::rethrow_exception(exception);
+			}
+		}
+	};
+}
+
+// Asynchronous pipeline step written as a coroutine:
+//
+//	Task<Mesh*> LoadMesh(ThreadPool& pool, std::string file)
+//	{
+//		co_await pool.Schedule(JobPriority::IO);	// read on an IO thread
+//		auto data = ReadFile(file);
+//		co_await pool.Schedule();					// decode on a worker
+//		auto meshData = Decode(data);
+//		co_await pool.SwitchToMainThread();			// resumes in ExecuteCallbacks
+//		co_return CreateMesh(meshData);
+//	}
+//
+// Awaiting a Task starts it inline and resumes the awaiter on whatever
+// thread the Task finished on. A Task that is never awaited has to be kept
+// alive and started with Start until IsDone returns true.
+template<typename T = void>
+class Task
+{
+public:
+	using promise_type = TaskDetail::Promise<T>;
+
+	Task() {};
+	explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {};
+	Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {};
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Destroy();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task() { Destroy(); }
+
+	// Runs the task on the calling thread until its first suspension
+	void Start() { handle.resume(); }
+
+	bool IsValid() const { return bool(handle); }
+	bool IsDone() const { return handle && handle.promise().isDone.load(std::memory_order_acquire); }
+
+	// Only valid once IsDone, rethrows anything the coroutine threw
+	T GetResult() { return handle.promise().TakeResult(); }
+
+	struct Awaiter
+	{
+		std::coroutine_handle<promise_type> handle;
+
+		bool await_ready() noexcept { return !handle || handle.done(); }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+		{
+			handle.promise().continuation = awaiting;
+			return handle;
+		}
+		T await_resume() { return handle.promise().TakeResult(); }
+	};
+
+	Awaiter operator co_await() const& noexcept { return Awaiter{ handle }; }
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	void Destroy()
+	{
+		if (handle)
+		{
+			handle.destroy();
+			handle = nullptr;
+		}
+	}
+};
+
+namespace TaskDetail
+{
+	template<typename T>
+	Task<T> Promise<T>::get_return_object()
+	{
+		return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+	}
+
+	inline Task<void> Promise<void>::get_return_object()
+	{
+		return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+	}
+}
\ No newline at end of file
@@ -1,8 +1,58 @@
 #include "ThreadPool.h"
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
+#ifdef _MSC_VER
+#define JOB_NOINLINE __declspec(noinline)
+#else
+#define JOB_NOINLINE __attribute__((noinline))
+#endif
+
+// Set on every worker thread of a fiber pool. Always read through
+// GetWorkerContext, a fiber may resume on a different thread and the
+// compiler must not reuse a TLS address computed before the switch.
+static thread_local void* tlsWorkerContext = nullptr;
+
+// Tells the core we are in a spin-wait loop, saving power and the
+// sibling hyper-thread's resources
+static inline void CpuRelax()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
 
 ThreadPool::ThreadPool(size_t numberOfThreads)
 {
+	settings.numberOfThreads = numberOfThreads;
+	cpuTopology = CpuTopology::Query();
+	Start(numberOfThreads);
+}
+
+ThreadPool::ThreadPool(const ThreadPoolSettings& settings)
+	: settings(settings)
+{
+	cpuTopology = CpuTopology::Query();
+
+	if (settings.useFibers)
+	{
+		for (size_t i = 0; i < settings.fiberCount; ++i)
+		{
+			auto jobFiber = make_unique<JobFiber>();
+			jobFiber->fiber.Create(settings.fiberStackSize, &ThreadPool::FiberMain, jobFiber.get());
+			freeFibers.push_back(jobFiber.get());
+			fibers.push_back(move(jobFiber));
+		}
+	}
+
+	auto numberOfThreads = settings.numberOfThreads;
+	if (numberOfThreads == 0)
+	{
+		numberOfThreads = max<size_t>(1, cpuTopology.GetUsableCores() - 1);
+	}
 	Start(numberOfThreads);
 }
 
@@ -13,52 +63,683 @@ ThreadPool::~ThreadPool()
 
 void ThreadPool::Start(size_t numberOfThreads)
 {
-	for (auto i = 0; i < numberOfThreads; ++i)
+	workerStats.reset(new WorkerStatsData[numberOfThreads]);
+
+	for (size_t i = 0; i < numberOfThreads; ++i)
+	{
+		threads.emplace_back([this, i]
+		{
+			InitializeWorkerThread(i, false);
+			if (settings.useFibers)
+			{
+				FiberWorkerLoop(i);
+			}
+			else
+			{
+				WorkerLoop(i);
+			}
+		});
+	}
+
+	for (size_t i = 0; i < settings.numberOfIOThreads; ++i)
+	{
+		ioThreads.emplace_back([this, i]
+		{
+			InitializeWorkerThread(i, true);
+			IOWorkerLoop();
+		});
+	}
+}
+
+void ThreadPool::InitializeWorkerThread(size_t index, bool isIOThread)
+{
+	auto name = (isIOThread ? "IO " : "") + settings.threadName + " " + to_string(index);
+	CpuTopology::SetCurrentThreadName(name);
+	JobProfiler::Get().SetThreadName(name);
+
+	// IO threads mostly sleep in the kernel, let the OS place them
+	auto& cpuIds = cpuTopology.cpuIds;
+	if (settings.pinWorkers && !isIOThread && cpuIds.size() > 1)
+	{
+		CpuTopology::PinCurrentThread(cpuIds[1 + index % (cpuIds.size() - 1)]);
+	}
+}
+
+void ThreadPool::Stop() noexcept
+{
+	{
+		InstrumentedLock lock{ mtx, mtxStats };
+		isStopped = true;
+	}
+
+	cv.notify_all();
+
+	for (auto &thread : threads)
+	{
+		thread.join();
+	}
+
+	{
+		InstrumentedLock lock{ ioMtx, ioMtxStats };
+		isIOStopped = true;
+	}
+	ioCv.notify_all();
+
+	for (auto &thread : ioThreads)
 	{
+		thread.join();
+	}
+}
+
+bool ThreadPool::SpinForWork(WorkerStatsData& stats)
+{
+	for (uint32_t i = 0; i < settings.spinCount; ++i)
+	{
+		if (pendingTasks.load(memory_order_relaxed) > 0)
+		{
+			WorkerStatsData::Add(stats.spinWakeups, 1);
+			return true;
+		}
+		CpuRelax();
+	}
+
+	for (uint32_t i = 0; i < settings.yieldCount; ++i)
+	{
+		if (pendingTasks.load(memory_order_relaxed) > 0)
+		{
+			WorkerStatsData::Add(stats.yieldWakeups, 1);
+			return true;
+		}
+		this_thread::yield();
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+	auto& stats = workerStats[index];
+	while (true)
+	{
+		Task task;
+		auto idleStart = Clock::now();
+		if (pendingTasks.load(memory_order_relaxed) == 0)
+		{
+			SpinForWork(stats);
+		}
 
-		threads.emplace_back([&]
 		{
-			while (true)
+			InstrumentedLock lock{ mtx, mtxStats };
+			if (!isStopped && pendingTasks == 0)
 			{
-				Task task;
-				{
-					unique_lock<mutex> lock{ mtx };
-					cv.wait(lock, [=] { return isStopped || !taskQueue.empty(); });
+				WorkerStatsData::Add(stats.parks, 1);
+				parkedWorkers++;
+				lock.Wait(cv, [this] { return isStopped || pendingTasks > 0; });
+				parkedWorkers--;
+			}
+
+			if (!PopTask(task))
+			{
+				break;
+			}
+		}
+
+		WorkerStatsData::Add(stats.idleNanoseconds, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(Clock::now() - idleStart).count());
+		task();
+		WorkerStatsData::Add(stats.jobsExecuted, 1);
+	}
+}
+
+void ThreadPool::IOWorkerLoop()
+{
+	while (true)
+	{
+		Task task;
+		{
+			InstrumentedLock lock{ ioMtx, ioMtxStats };
+			lock.Wait(ioCv, [this] { return isIOStopped || !ioLane.tasks.empty(); });
+
+			if (ioLane.tasks.empty())
+			{
+				break;
+			}
+
+			task = ioLane.Pop();
+		}
+		task();
+	}
+}
 
-					if (isStopped && taskQueue.empty())
+void ThreadPool::FiberWorkerLoop(size_t index)
+{
+	auto& stats = workerStats[index];
+	WorkerContext context;
+	context.owner = this;
+	context.schedulerFiber.ConvertCurrentThread();
+	tlsWorkerContext = &context;
+
+	while (true)
+	{
+		JobFiber* jobFiber = nullptr;
+		Task task;
+		auto idleStart = Clock::now();
+		if (pendingTasks.load(memory_order_relaxed) == 0)
+		{
+			SpinForWork(stats);
+		}
+
+		{
+			InstrumentedLock lock{ mtx, mtxStats };
+
+			// Parked jobs are resumed before new ones are started
+			auto hasWork = [&]
+			{
+				jobFiber = PopReadyFiber();
+				return jobFiber || isStopped || pendingTasks > 0;
+			};
+
+			if (!hasWork())
+			{
+				WorkerStatsData::Add(stats.parks, 1);
+				parkedWorkers++;
+				lock.Wait(cv, hasWork);
+				parkedWorkers--;
+			}
+
+			if (!jobFiber)
+			{
+				if (!PopTask(task))
+				{
+					if (waitingFibers.empty())
 					{
 						break;
 					}
 
-					task = move(taskQueue.front());
-					taskQueue.pop();
+					// Stopping, but parked jobs still have to finish
+					lock.Unlock();
+					this_thread::yield();
+					continue;
+				}
+				WorkerStatsData::Add(stats.jobsExecuted, 1);
+
+				if (!freeFibers.empty())
+				{
+					jobFiber = freeFibers.back();
+					freeFibers.pop_back();
+					jobFiber->task = move(task);
 				}
-				task();
 			}
-		});
+		}
+
+		WorkerStatsData::Add(stats.idleNanoseconds, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(Clock::now() - idleStart).count());
+
+		if (!jobFiber)
+		{
+			// Fiber pool exhausted, run on the worker's own stack. A wait
+			// inside this job falls back to helping instead of parking.
+			task();
+			continue;
+		}
+
+		context.currentFiber = jobFiber;
+		context.schedulerFiber.SwitchTo(jobFiber->fiber);
+		context.currentFiber = nullptr;
+
+		// The fiber has switched out completely, only now may another
+		// worker see it in one of the lists
+		{
+			InstrumentedLock lock{ mtx, mtxStats };
+			if (jobFiber->waitCounter)
+			{
+				waitingFibers.push_back(jobFiber);
+			}
+			else
+			{
+				freeFibers.push_back(jobFiber);
+			}
+		}
+		cv.notify_one();
+		mtxStats.RecordNotify();
 	}
+
+	tlsWorkerContext = nullptr;
+	context.schedulerFiber.RevertCurrentThread();
 }
 
-void ThreadPool::Stop() noexcept
+void ThreadPool::FiberMain(void* data)
 {
+	auto jobFiber = static_cast<JobFiber*>(data);
+	while (true)
 	{
-		unique_lock<mutex> lock{ mtx };
-		isStopped = true;
+		jobFiber->task();
+		jobFiber->task = nullptr;
+
+		// Hand the fiber back to whichever worker is running it now
+		auto context = GetWorkerContext();
+		jobFiber->fiber.SwitchTo(context->schedulerFiber);
 	}
+}
 
-	cv.notify_all();
+JOB_NOINLINE ThreadPool::WorkerContext* ThreadPool::GetWorkerContext()
+{
+	return static_cast<WorkerContext*>(tlsWorkerContext);
+}
 
-	for (auto &thread : threads)
+ThreadPool::JobFiber* ThreadPool::PopReadyFiber()
+{
+	for (auto it = waitingFibers.begin(); it != waitingFibers.end(); ++it)
 	{
-		thread.join();
+		if ((*it)->waitCounter->IsZero())
+		{
+			auto jobFiber = *it;
+			waitingFibers.erase(it);
+			jobFiber->waitCounter = nullptr;
+			return jobFiber;
+		}
+	}
+	return nullptr;
+}
+
+void ThreadPool::Enqueue(IJob* task, JobCounter* counter, JobPriority priority)
+{
+	if (counter)
+	{
+		counter->Increment();
+		counter->NoteLane((int)priority);
+	}
+
+	auto& profiler = JobProfiler::Get();
+	uint64_t enqueueTime = profiler.IsEnabled() ? profiler.Now() : 0;
+	Push(MakeJobTask(task, counter, priority, enqueueTime), priority);
+}
+
+void ThreadPool::EnqueueBatch(span<IJob* const> tasks, JobCounter* counter, JobPriority priority)
+{
+	if (tasks.empty())
+	{
+		return;
 	}
+
+	if (counter)
+	{
+		counter->Increment((int)tasks.size());
+		counter->NoteLane((int)priority);
+	}
+
+	auto& profiler = JobProfiler::Get();
+	uint64_t enqueueTime = profiler.IsEnabled() ? profiler.Now() : 0;
+
+	// Build the wrappers outside the lock, then publish them all at once
+	vector<Task> wrappers;
+	wrappers.reserve(tasks.size());
+	for (auto task : tasks)
+	{
+		wrappers.push_back(MakeJobTask(task, counter, priority, enqueueTime));
+	}
+
+	if (priority == JobPriority::IO)
+	{
+		{
+			InstrumentedLock lock{ ioMtx, ioMtxStats };
+			for (auto& wrapper : wrappers)
+			{
+				ioLane.Push(move(wrapper));
+			}
+			ioMtxStats.RecordDepth(ioLane.tasks.size());
+		}
+		ioMtxStats.RecordNotify(NotifyWorkers(ioCv, wrappers.size(), ioThreads.size(), ioThreads.size()));
+		return;
+	}
+
+	size_t parkedCount = 0;
+	{
+		InstrumentedLock lock{ mtx, mtxStats };
+		auto& lane = lanes[(size_t)priority];
+		for (auto& wrapper : wrappers)
+		{
+			lane.Push(move(wrapper));
+		}
+		pendingTasks += wrappers.size();
+		parkedCount = parkedWorkers;
+		mtxStats.RecordDepth(pendingTasks.load(memory_order_relaxed));
+	}
+	mtxStats.RecordNotify(NotifyWorkers(cv, wrappers.size(), threads.size(), parkedCount));
+}
+
+size_t ThreadPool::NotifyWorkers(condition_variable& condition, size_t taskCount, size_t workerCount, size_t parkedCount)
+{
+	// Spinning workers pick the jobs up on their own
+	if (parkedCount == 0)
+	{
+		return 0;
+	}
+
+	// Wake only as many workers as there are jobs for
+	taskCount = min(taskCount, parkedCount);
+	if (taskCount >= workerCount)
+	{
+		condition.notify_all();
+		return 1;
+	}
+
+	for (size_t i = 0; i < taskCount; ++i)
+	{
+		condition.notify_one();
+	}
+	return taskCount;
+}
+
+ThreadPool::Task ThreadPool::MakeJobTask(IJob* task, JobCounter* counter, JobPriority priority, uint64_t enqueueTime)
+{
+	task->SetIsCompleted(false);
+	uint64_t enqueuedFrame = GetCurrentFrame();
+
+	auto& profiler = JobProfiler::Get();
+	return [=, this, &profiler]
+	{
+		uint64_t profilerEndTime = 0;
+		if (enqueueTime)
+		{
+			JobEvent event = { task->GetName(), enqueueTime, profiler.Now(), 0,
+				profiler.GetCurrentFrame(), (uint8_t)priority, JobEventType::Job };
+			task->Execute();
+			event.endTime = profiler.Now();
+			profilerEndTime = event.endTime;
+			profiler.Record(event);
+		}
+		else
+		{
+			task->Execute();
+		}
+		uint64_t completedFrame = GetCurrentFrame();
+		task->SetIsCompleted(true);
+		CallbackQueue.Push({ task, enqueuedFrame, completedFrame, profilerEndTime });
+		if (counter)
+		{
+			OnCounterDecremented(counter);
+		}
+	};
+}
+
+void ThreadPool::Post(Task task, JobPriority priority, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->Increment();
+		counter->NoteLane((int)priority);
+		task = [this, task = move(task), counter]
+		{
+			task();
+			OnCounterDecremented(counter);
+		};
+	}
+	Push(move(task), priority);
+}
+
+void ThreadPool::PostToMainThread(Task task)
+{
+	MainThreadQueue.Push(task);
 }
 
-void ThreadPool::ExecuteCallbacks()
+void ThreadPool::Push(Task&& task, JobPriority priority)
 {
-	while (!CallbackQueue.IsEmpty())
+	if (priority == JobPriority::IO)
+	{
+		{
+			InstrumentedLock lock{ ioMtx, ioMtxStats };
+			ioLane.Push(move(task));
+			ioMtxStats.RecordDepth(ioLane.tasks.size());
+		}
+		ioCv.notify_one();
+		ioMtxStats.RecordNotify();
+		return;
+	}
+
+	bool hasParkedWorkers = false;
 	{
-		auto popped = CallbackQueue.Pop();
-		popped->Callback();
+		InstrumentedLock lock{ mtx, mtxStats };
+		lanes[(size_t)priority].Push(move(task));
+		pendingTasks++;
+		hasParkedWorkers = parkedWorkers > 0;
+		mtxStats.RecordDepth(pendingTasks.load(memory_order_relaxed));
 	}
+
+	// Spinning workers pick the job up without a kernel wakeup
+	if (hasParkedWorkers)
+	{
+		cv.notify_one();
+		mtxStats.RecordNotify();
+	}
+}
+
+bool ThreadPool::PopTask(Task& task, JobPriority lowestLane)
+{
+	for (size_t i = 0; i <= (size_t)lowestLane; ++i)
+	{
+		if (!lanes[i].tasks.empty())
+		{
+			task = lanes[i].Pop();
+			pendingTasks--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::Lane::Push(Task&& task)
+{
+	tasks.push({ move(task), Clock::now() });
+	maxQueueDepth = max(maxQueueDepth, tasks.size());
+}
+
+ThreadPool::Task ThreadPool::Lane::Pop()
+{
+	auto queued = move(tasks.front());
+	tasks.pop();
+
+	double latencyMs = chrono::duration<double, milli>(Clock::now() - queued.enqueueTime).count();
+	totalLatencyMs += latencyMs;
+	maxLatencyMs = max(maxLatencyMs, latencyMs);
+	jobsStarted++;
+
+	return move(queued.task);
+}
+
+LaneStats ThreadPool::GetLaneStats(JobPriority priority)
+{
+	bool isIO = priority == JobPriority::IO;
+	InstrumentedLock lock{ isIO ? ioMtx : mtx, isIO ? ioMtxStats : mtxStats };
+	auto& lane = priority == JobPriority::IO ? ioLane : lanes[(size_t)priority];
+
+	LaneStats stats;
+	stats.queueDepth = lane.tasks.size();
+	stats.maxQueueDepth = lane.maxQueueDepth;
+	stats.jobsStarted = lane.jobsStarted;
+	stats.averageLatencyMs = lane.jobsStarted ? lane.totalLatencyMs / lane.jobsStarted : 0.0;
+	stats.maxLatencyMs = lane.maxLatencyMs;
+	return stats;
+}
+
+vector<WorkerStats> ThreadPool::GetWorkerStats()
+{
+	vector<WorkerStats> result(threads.size());
+	for (size_t i = 0; i < threads.size(); ++i)
+	{
+		auto& stats = workerStats[i];
+		result[i].jobsExecuted = stats.jobsExecuted.load(memory_order_relaxed);
+		result[i].spinWakeups = stats.spinWakeups.load(memory_order_relaxed);
+		result[i].yieldWakeups = stats.yieldWakeups.load(memory_order_relaxed);
+		result[i].parks = stats.parks.load(memory_order_relaxed);
+		result[i].idleMs = stats.idleNanoseconds.load(memory_order_relaxed) / 1e6;
+	}
+	return result;
+}
+
+void ThreadPool::ResetWorkerStats()
+{
+	// Racy against the owning workers' read-modify-write, good enough for stats
+	for (size_t i = 0; i < threads.size(); ++i)
+	{
+		auto& stats = workerStats[i];
+		stats.jobsExecuted.store(0, memory_order_relaxed);
+		stats.spinWakeups.store(0, memory_order_relaxed);
+		stats.yieldWakeups.store(0, memory_order_relaxed);
+		stats.parks.store(0, memory_order_relaxed);
+		stats.idleNanoseconds.store(0, memory_order_relaxed);
+	}
+}
+
+void ThreadPool::ResetLaneStats()
+{
+	auto reset = [](Lane& lane)
+	{
+		lane.maxQueueDepth = lane.tasks.size();
+		lane.jobsStarted = 0;
+		lane.totalLatencyMs = 0.0;
+		lane.maxLatencyMs = 0.0;
+	};
+
+	{
+		InstrumentedLock lock{ mtx, mtxStats };
+		for (auto& lane : lanes)
+		{
+			reset(lane);
+		}
+	}
+
+	InstrumentedLock lock{ ioMtx, ioMtxStats };
+	reset(ioLane);
+}
+
+vector<LockStatsSnapshot> ThreadPool::GetLockStats()
+{
+	return { mtxStats.Snapshot(), ioMtxStats.Snapshot(),
+		CallbackQueue.GetLockStats().Snapshot(), MainThreadQueue.GetLockStats().Snapshot() };
+}
+
+void ThreadPool::ResetLockStats()
+{
+	mtxStats.Reset();
+	ioMtxStats.Reset();
+	CallbackQueue.GetLockStats().Reset();
+	MainThreadQueue.GetLockStats().Reset();
+}
+
+void ThreadPool::OnCounterDecremented(JobCounter* counter)
+{
+	if (counter->Decrement() == 0 && settings.useFibers)
+	{
+		// A parked fiber may be waiting on this counter. Taking the lock
+		// orders the wakeup after any worker's predicate check.
+		{
+			InstrumentedLock lock{ mtx, mtxStats };
+		}
+		cv.notify_all();
+		mtxStats.RecordNotify();
+	}
+}
+
+void ThreadPool::WaitForCounter(JobCounter* counter)
+{
+	auto context = GetWorkerContext();
+	if (context && context->owner == this && context->currentFiber)
+	{
+		// Park this job and let the worker run something else. The fiber is
+		// resumed by the first worker that sees the counter at zero.
+		auto jobFiber = context->currentFiber;
+		while (!counter->IsZero())
+		{
+			jobFiber->waitCounter = counter;
+			jobFiber->fiber.SwitchTo(context->schedulerFiber);
+			context = GetWorkerContext();
+		}
+		return;
+	}
+
+	// IO jobs only run on the IO threads, help with background work meanwhile
+	auto lowestLane = (JobPriority)min(counter->GetLowestLane(), (int)JobPriority::Background);
+	while (!counter->IsZero())
+	{
+		if (!TryExecuteOne(lowestLane))
+		{
+			this_thread::yield();
+		}
+	}
+}
+
+bool ThreadPool::TryExecuteOne(JobPriority lowestLane)
+{
+	Task task;
+	{
+		InstrumentedLock lock{ mtx, mtxStats };
+
+		// Lower lanes may hold long jobs the waiter doesn't depend on
+		if (!PopTask(task, lowestLane))
+		{
+			return false;
+		}
+	}
+	task();
+	return true;
+}
+
+void ThreadPool::BeginFrame(uint64_t frame)
+{
+	currentFrame.store(frame, memory_order_relaxed);
+	JobProfiler::Get().BeginFrame(frame);
+}
+
+size_t ThreadPool::ExecuteCallbacks(double budgetMs)
+{
+	auto& profiler = JobProfiler::Get();
+	auto start = Clock::now();
+
+	auto isOverBudget = [&]
+	{
+		return budgetMs > 0.0 && chrono::duration<double, milli>(Clock::now() - start).count() >= budgetMs;
+	};
+
+	// Deferred work stays in front so completion order is kept
+	MainThreadQueue.PopAll(pendingMainThreadTasks);
+	CallbackQueue.PopAll(pendingCallbacks);
+
+	// Continuations first, they are pipelines waiting to make progress
+	size_t executedTasks = 0;
+	for (; executedTasks < pendingMainThreadTasks.size(); ++executedTasks)
+	{
+		if (executedTasks > 0 && isOverBudget())
+		{
+			break;
+		}
+		pendingMainThreadTasks[executedTasks]();
+	}
+	pendingMainThreadTasks.erase(pendingMainThreadTasks.begin(), pendingMainThreadTasks.begin() + executedTasks);
+
+	size_t executed = 0;
+	for (; executed < pendingCallbacks.size(); ++executed)
+	{
+		if ((executed > 0 || executedTasks > 0) && isOverBudget())
+		{
+			break;
+		}
+
+		auto& completed = pendingCallbacks[executed];
+		auto popped = completed.job;
+		popped->enqueuedFrame = completed.enqueuedFrame;
+		popped->completedFrame = completed.completedFrame;
+		if (completed.profilerEndTime && profiler.IsEnabled())
+		{
+			JobEvent event = { popped->GetName(), completed.profilerEndTime, profiler.Now(), 0,
+				profiler.GetCurrentFrame(), 0, JobEventType::Callback };
+			popped->Callback();
+			event.endTime = profiler.Now();
+			profiler.Record(event);
+		}
+		else
+		{
+			popped->Callback();
+		}
+	}
+
+	pendingCallbacks.erase(pendingCallbacks.begin(), pendingCallbacks.begin() + executed);
+	return executedTasks + executed;
 }
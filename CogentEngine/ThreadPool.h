@@ -2,55 +2,283 @@
 #include <functional>
 #include <vector>
 #include <iostream>
-#include <future>
 #include <thread> 
 #include <condition_variable>
 #include <mutex>
 #include <queue>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <coroutine>
+#include <span>
 #include "IJob.h"
+#include "JobCounter.h"
+#include "Fiber.h"
+#include "CpuTopology.h"
+#include "JobProfiler.h"
 #include "ConcurrentQueue.h"
+#include "LockStats.h"
 
 using namespace std;
 
+// Workers always take from the highest lane that has work. IO jobs never run
+// on the workers, they go to a separate set of threads that may block.
+enum class JobPriority
+{
+	Critical,
+	Normal,
+	Background,
+	IO,
+	Count
+};
+
+struct LaneStats
+{
+	size_t queueDepth = 0;
+	size_t maxQueueDepth = 0;
+	uint64_t jobsStarted = 0;
+	double averageLatencyMs = 0.0;	// enqueue to start
+	double maxLatencyMs = 0.0;
+};
+
+struct WorkerStats
+{
+	uint64_t jobsExecuted = 0;
+	uint64_t spinWakeups = 0;	// found work while spinning
+	uint64_t yieldWakeups = 0;	// found work while yielding
+	uint64_t parks = 0;			// went to sleep on the condition variable
+	double idleMs = 0.0;
+};
+
+struct ThreadPoolSettings
+{
+	// 0 sizes the pool from the hardware: one worker per usable core, leaving
+	// one core for the main thread
+	size_t numberOfThreads = 0;
+	size_t numberOfIOThreads = 2;
+
+	// Pin worker i to its own core, skipping the first one for the main thread
+	bool pinWorkers = false;
+
+	// Threads are named "<threadName> <index>" for debuggers and profilers
+	string threadName = "Worker";
+
+	// An idle worker first spins with a pause instruction, then yields its
+	// time slice, and only then parks on the condition variable. Spinning
+	// burns CPU but picks up a new job without a kernel wakeup. 0/0 parks
+	// immediately.
+	uint32_t spinCount = 1000;
+	uint32_t yieldCount = 10;
+
+	// Run jobs on pooled fibers so WaitForCounter inside a job suspends the
+	// job instead of the worker thread. The job resumes on any free worker.
+	bool useFibers = false;
+	size_t fiberCount = 128;
+	size_t fiberStackSize = 64 * 1024;
+};
+
 class ThreadPool
 {
 public:
 	explicit ThreadPool(size_t numberOfThreads);
+	explicit ThreadPool(const ThreadPoolSettings& settings);
 	~ThreadPool();
 
 	using Task = function<void()>;
 
-	auto Enqueue(IJob* task)-> future<void>
+	// Queues the job for a worker. If a counter is given it is incremented now
+	// and decremented once the job has executed.
+	void Enqueue(IJob* task, JobCounter* counter = nullptr, JobPriority priority = JobPriority::Normal);
+
+	// Enqueues all jobs with one lock and wakes at most one worker per job.
+	// The counter, if any, is incremented once by the number of jobs.
+	void EnqueueBatch(span<IJob* const> tasks, JobCounter* counter = nullptr, JobPriority priority = JobPriority::Normal);
+
+	// Blocks until the counter reaches zero. Inside a fiber job the fiber is
+	// parked and the worker moves on; anywhere else the calling thread executes
+	// other pending jobs while it waits, down to the lowest lane the counter's
+	// jobs were queued on. A frame waiting on critical work therefore never
+	// picks up a long background job, while a wait on background work can run
+	// that work itself.
+	void WaitForCounter(JobCounter* counter);
+
+	// Runs a plain function on the pool, for work that needs no IJob. A counter
+	// is handled like Enqueue's.
+	void Post(Task task, JobPriority priority = JobPriority::Normal, JobCounter* counter = nullptr);
+
+	// Runs a function on the main thread during the next ExecuteCallbacks
+	void PostToMainThread(Task task);
+
+	// co_await pool.Schedule() resumes the coroutine on a worker of the lane
+	struct ScheduleAwaiter
+	{
+		ThreadPool* pool;
+		JobPriority priority;
+
+		bool await_ready() noexcept { return false; }
+		void await_suspend(coroutine_handle<> handle) { pool->Post([handle] { handle.resume(); }, priority); }
+		void await_resume() noexcept {}
+	};
+	ScheduleAwaiter Schedule(JobPriority priority = JobPriority::Normal) { return { this, priority }; }
+
+	// co_await pool.SwitchToMainThread() resumes the coroutine in ExecuteCallbacks
+	struct MainThreadAwaiter
 	{
-		task->SetIsCompleted(false);
-		auto wrapper = make_shared<packaged_task<void()>>([task] { task->Execute(); });
+		ThreadPool* pool;
+
+		bool await_ready() noexcept { return false; }
+		void await_suspend(coroutine_handle<> handle) { pool->PostToMainThread([handle] { handle.resume(); }); }
+		void await_resume() noexcept {}
+	};
+	MainThreadAwaiter SwitchToMainThread() { return { this }; }
+
+	// Stamps jobs enqueued or completed from now on with this frame
+	void BeginFrame(uint64_t frame);
+	uint64_t GetCurrentFrame() const { return currentFrame.load(memory_order_relaxed); }
+
+	// Runs main thread continuations and the callbacks of finished jobs on the
+	// calling thread. Everything finished is drained in one go; with a budget,
+	// work left over once it is used up is deferred to the next call.
+	// Returns the number of functions and callbacks executed.
+	size_t ExecuteCallbacks(double budgetMs = 0.0);
+	size_t GetDeferredCallbackCount() const { return pendingCallbacks.size() + pendingMainThreadTasks.size(); }
+
+	size_t GetNumberOfThreads() const { return threads.size(); }
+	const CpuTopology& GetCpuTopology() const { return cpuTopology; }
+
+	LaneStats GetLaneStats(JobPriority priority);
+	void ResetLaneStats();
 
+	vector<WorkerStats> GetWorkerStats();
+	void ResetWorkerStats();
+
+	// Wait/hold times, queue depth high-water marks and wakeups of the pool
+	// mutex, the IO mutex and both callback queues. Only recorded while
+	// LockStats::SetEnabled(true); print with LockStats::Print.
+	vector<LockStatsSnapshot> GetLockStats();
+	void ResetLockStats();
+private:
+	using Clock = chrono::steady_clock;
+
+	struct QueuedTask
+	{
+		Task task;
+		Clock::time_point enqueueTime;
+	};
+
+	struct Lane
+	{
+		queue<QueuedTask> tasks;
+		size_t maxQueueDepth = 0;
+		uint64_t jobsStarted = 0;
+		double totalLatencyMs = 0.0;
+		double maxLatencyMs = 0.0;
+
+		void Push(Task&& task);
+		Task Pop();
+	};
+
+	struct JobFiber
+	{
+		Fiber fiber;
+		Task task;
+		JobCounter* waitCounter = nullptr;
+	};
+
+	struct WorkerStatsData
+	{
+		atomic<uint64_t> jobsExecuted{ 0 };
+		atomic<uint64_t> spinWakeups{ 0 };
+		atomic<uint64_t> yieldWakeups{ 0 };
+		atomic<uint64_t> parks{ 0 };
+		atomic<uint64_t> idleNanoseconds{ 0 };
+
+		// Only the owning worker writes, so a relaxed load and store is enough
+		static void Add(atomic<uint64_t>& value, uint64_t amount)
 		{
-			unique_lock<mutex> lock{ mtx };
-			taskQueue.emplace([=]
-			{
-				(*wrapper)();
-				task->SetIsCompleted(true);
-				CallbackQueue.Push(task);
-			});
+			value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
 		}
-		cv.notify_one();
-		return wrapper->get_future();
-	}
+	};
 
-	void ExecuteCallbacks();
-private:
+	struct WorkerContext
+	{
+		ThreadPool* owner = nullptr;
+		Fiber schedulerFiber;
+		JobFiber* currentFiber = nullptr;
+	};
+
+	ThreadPoolSettings settings;
+	CpuTopology cpuTopology;
 	vector<thread> threads;
 	condition_variable cv;
 	mutex mtx;
+	LockStats mtxStats{ "ThreadPool" };
 	bool isStopped = false;
-	queue<Task> taskQueue;
-	ConcurrentQueue<IJob*> CallbackQueue;
+	Lane lanes[(size_t)JobPriority::IO];
+
+	// Written under mtx, spinning workers read it without the lock
+	atomic<size_t> pendingTasks{ 0 };
+	size_t parkedWorkers = 0;
+	unique_ptr<WorkerStatsData[]> workerStats;
+	// One per finished run, the job object itself may be enqueued again
+	// before its callback is executed
+	struct CompletedJob
+	{
+		IJob* job;
+		uint64_t enqueuedFrame;
+		uint64_t completedFrame;
+		// Set while the JobProfiler is enabled
+		uint64_t profilerEndTime;
+	};
+	ConcurrentQueue<CompletedJob> CallbackQueue{ "CallbackQueue" };
+	atomic<uint64_t> currentFrame{ 0 };
+
+	ConcurrentQueue<Task> MainThreadQueue{ "MainThreadQueue" };
+
+	// Drained but not yet executed callbacks, main thread only
+	vector<CompletedJob> pendingCallbacks;
+	vector<Task> pendingMainThreadTasks;
+
+	// Blocking IO lane, served only by ioThreads
+	vector<thread> ioThreads;
+	condition_variable ioCv;
+	mutex ioMtx;
+	LockStats ioMtxStats{ "ThreadPool IO" };
+	bool isIOStopped = false;
+	Lane ioLane;
+
+	// Fiber mode only, guarded by mtx
+	vector<unique_ptr<JobFiber>> fibers;
+	vector<JobFiber*> freeFibers;
+	vector<JobFiber*> waitingFibers;
 
 	void Start(size_t numberOfThreads);
+	void Push(Task&& task, JobPriority priority);
+	Task MakeJobTask(IJob* task, JobCounter* counter, JobPriority priority, uint64_t enqueueTime);
+	// Returns the number of notify calls made
+	static size_t NotifyWorkers(condition_variable& condition, size_t taskCount, size_t workerCount, size_t parkedCount);
+	void InitializeWorkerThread(size_t index, bool isIOThread);
 
 	void Stop() noexcept;
 
+	void WorkerLoop(size_t index);
+	void FiberWorkerLoop(size_t index);
+
+	// Spins, then yields, until a job is queued. Returns false if the worker should park.
+	bool SpinForWork(WorkerStatsData& stats);
+	void IOWorkerLoop();
+	static void FiberMain(void* data);
+	static WorkerContext* GetWorkerContext();
+
+	// Pops the next task from the highest non-empty lane up to lowestLane. Requires mtx.
+	bool PopTask(Task& task, JobPriority lowestLane = JobPriority::Background);
+
+	// Pops and runs one pending job down to lowestLane, returns false if there was none
+	bool TryExecuteOne(JobPriority lowestLane);
 
+	// Takes a parked fiber whose counter has reached zero. Requires mtx.
+	JobFiber* PopReadyFiber();
+	void OnCounterDecremented(JobCounter* counter);
 
 };
\ No newline at end of file
@@ -0,0 +1,568 @@
+#include "TransformSystem.h"
+#include "Job.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define TRANSFORM_SYSTEM_SSE 1
+#endif
+
+TransformSystem::TransformSystem()
+{
+}
+
+TransformSystem::~TransformSystem()
+{
+}
+
+uint32_t TransformSystem::Create()
+{
+	uint32_t index;
+	if (!freeSlots.empty())
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)count++;
+		positionX.push_back(0.0f);
+		positionY.push_back(0.0f);
+		positionZ.push_back(0.0f);
+		rotationX.push_back(0.0f);
+		rotationY.push_back(0.0f);
+		rotationZ.push_back(0.0f);
+		rotationW.push_back(1.0f);
+		scaleX.push_back(1.0f);
+		scaleY.push_back(1.0f);
+		scaleZ.push_back(1.0f);
+		eulerRotations.push_back(XMFLOAT3(0.0f, 0.0f, 0.0f));
+		parents.push_back(INVALID_TRANSFORM);
+		firstChildren.push_back(INVALID_TRANSFORM);
+		nextSiblings.push_back(INVALID_TRANSFORM);
+		isChild.push_back(0);
+		worldMatrices.push_back(XMFLOAT4X4());
+		localBounds.push_back(BoundingOrientedBox());
+		worldBounds.push_back(BoundingOrientedBox());
+		worldAABBs.push_back(BoundingBox());
+		dirty.push_back(0);
+	}
+
+	ResetSlot(index);
+	MarkDirty(index);
+	return index;
+}
+
+void TransformSystem::ResetSlot(uint32_t index)
+{
+	positionX[index] = positionY[index] = positionZ[index] = 0.0f;
+	rotationX[index] = rotationY[index] = rotationZ[index] = 0.0f;
+	rotationW[index] = 1.0f;
+	scaleX[index] = scaleY[index] = scaleZ[index] = 1.0f;
+	eulerRotations[index] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	XMStoreFloat4x4(&worldMatrices[index], XMMatrixIdentity());
+	localBounds[index] = BoundingOrientedBox();
+	worldBounds[index] = BoundingOrientedBox();
+	worldAABBs[index] = BoundingBox();
+}
+
+void TransformSystem::Destroy(uint32_t index)
+{
+	Unlink(index);
+
+	// Children keep their values, now relative to the world
+	uint32_t child = firstChildren[index];
+	while (child != INVALID_TRANSFORM)
+	{
+		uint32_t next = nextSiblings[child];
+		parents[child] = INVALID_TRANSFORM;
+		nextSiblings[child] = INVALID_TRANSFORM;
+		isChild[child] = 0;
+		MarkDirty(child);
+		child = next;
+	}
+	firstChildren[index] = INVALID_TRANSFORM;
+
+	if (dirty[index])
+	{
+		dirty[index] = 0;
+		dirtyCount.fetch_sub(1, memory_order_relaxed);
+	}
+	ResetSlot(index);
+	freeSlots.push_back(index);
+	hierarchyChanged = true;
+}
+
+// Removes the transform from its parent's child list and makes it a root
+void TransformSystem::Unlink(uint32_t index)
+{
+	uint32_t parent = parents[index];
+	if (parent == INVALID_TRANSFORM)
+		return;
+
+	uint32_t* link = &firstChildren[parent];
+	while (*link != index)
+	{
+		link = &nextSiblings[*link];
+	}
+	*link = nextSiblings[index];
+	parents[index] = INVALID_TRANSFORM;
+	nextSiblings[index] = INVALID_TRANSFORM;
+	isChild[index] = 0;
+}
+
+// Touches only this transform's flag, children may belong to another job
+void TransformSystem::MarkDirty(uint32_t index)
+{
+	if (dirty[index])
+		return;
+
+	dirty[index] = 1;
+	dirtyCount.fetch_add(1, memory_order_relaxed);
+}
+
+// Parents come before their descendants in hierarchyOrder, so one pass
+// carries the flags down whole subtrees
+void TransformSystem::PropagateDirty()
+{
+	size_t marked = 0;
+	for (uint32_t index : hierarchyOrder)
+	{
+		if (!dirty[index] && dirty[parents[index]])
+		{
+			dirty[index] = 1;
+			marked++;
+		}
+	}
+	dirtyCount.fetch_add(marked, memory_order_relaxed);
+}
+
+void TransformSystem::UpdateIfDirty(uint32_t index)
+{
+	// A dirty ancestor makes this one stale even if its own flag is clear
+	if (isChild[index])
+	{
+		UpdateIfDirty(parents[index]);
+	}
+	if (!dirty[index])
+		return;
+
+	// Once this one is clean PropagateDirty can't reach the children
+	for (uint32_t child = firstChildren[index]; child != INVALID_TRANSFORM; child = nextSiblings[child])
+	{
+		MarkDirty(child);
+	}
+
+	if (isChild[index])
+	{
+		UpdateChild(index);
+		recomputeCount.fetch_add(1, memory_order_relaxed);
+	}
+	else
+	{
+		UpdateRange(index, 1);
+	}
+	dirtyCount.fetch_sub(1, memory_order_relaxed);
+}
+
+bool TransformSystem::SetParent(uint32_t index, uint32_t parent)
+{
+	if (parents[index] == parent)
+		return true;
+
+	for (uint32_t ancestor = parent; ancestor != INVALID_TRANSFORM; ancestor = parents[ancestor])
+	{
+		if (ancestor == index)
+			return false;
+	}
+
+	Unlink(index);
+	if (parent != INVALID_TRANSFORM)
+	{
+		parents[index] = parent;
+		isChild[index] = 1;
+		nextSiblings[index] = firstChildren[parent];
+		firstChildren[parent] = index;
+	}
+
+	// The subtree may be clean but its world matrices are now wrong
+	MarkDirty(index);
+	hierarchyChanged = true;
+	return true;
+}
+
+void TransformSystem::RebuildHierarchyOrder()
+{
+	hierarchyOrder.clear();
+	subtreeStarts.clear();
+
+	vector<uint32_t> stack;
+	for (uint32_t root = 0; root < count; ++root)
+	{
+		if (isChild[root] || firstChildren[root] == INVALID_TRANSFORM)
+			continue;
+
+		subtreeStarts.push_back((uint32_t)hierarchyOrder.size());
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			uint32_t node = stack.back();
+			stack.pop_back();
+			if (node != root)
+			{
+				hierarchyOrder.push_back(node);
+			}
+			for (uint32_t child = firstChildren[node]; child != INVALID_TRANSFORM; child = nextSiblings[child])
+			{
+				stack.push_back(child);
+			}
+		}
+	}
+
+	if (!subtreeStarts.empty())
+	{
+		subtreeStarts.push_back((uint32_t)hierarchyOrder.size());
+	}
+	hierarchyChanged = false;
+}
+
+XMFLOAT3 TransformSystem::GetPosition(uint32_t index) const
+{
+	return XMFLOAT3(positionX[index], positionY[index], positionZ[index]);
+}
+
+void TransformSystem::SetPosition(uint32_t index, const XMFLOAT3& position)
+{
+	if (positionX[index] == position.x && positionY[index] == position.y && positionZ[index] == position.z)
+		return;
+
+	MarkDirty(index);
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+}
+
+XMFLOAT3 TransformSystem::GetRotation(uint32_t index) const
+{
+	return eulerRotations[index];
+}
+
+void TransformSystem::SetRotation(uint32_t index, const XMFLOAT3& rotation)
+{
+	auto& current = eulerRotations[index];
+	if (current.x == rotation.x && current.y == rotation.y && current.z == rotation.z)
+		return;
+
+	MarkDirty(index);
+	eulerRotations[index] = rotation;
+
+	XMFLOAT4 quaternion;
+	XMStoreFloat4(&quaternion, XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z));
+	rotationX[index] = quaternion.x;
+	rotationY[index] = quaternion.y;
+	rotationZ[index] = quaternion.z;
+	rotationW[index] = quaternion.w;
+}
+
+XMFLOAT4 TransformSystem::GetRotationQuaternion(uint32_t index) const
+{
+	return XMFLOAT4(rotationX[index], rotationY[index], rotationZ[index], rotationW[index]);
+}
+
+XMFLOAT3 TransformSystem::GetScale(uint32_t index) const
+{
+	return XMFLOAT3(scaleX[index], scaleY[index], scaleZ[index]);
+}
+
+void TransformSystem::SetScale(uint32_t index, const XMFLOAT3& scale)
+{
+	if (scaleX[index] == scale.x && scaleY[index] == scale.y && scaleZ[index] == scale.z)
+		return;
+
+	MarkDirty(index);
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+}
+
+void TransformSystem::SetLocalBounds(uint32_t index, const BoundingOrientedBox& bounds)
+{
+	localBounds[index] = bounds;
+	MarkDirty(index);
+}
+
+void TransformSystem::UpdateRange(size_t first, size_t rangeCount)
+{
+	size_t end = first + rangeCount;
+	size_t i = first;
+#if TRANSFORM_SYSTEM_SSE
+	for (; i + 4 <= end; i += 4)
+	{
+		// Clean lanes are recomputed along with dirty ones, same result.
+		// Children hold a parent relative matrix here, so groups with a
+		// child lane go through the scalar path.
+		uint32_t groupDirty, groupChildren;
+		memcpy(&groupDirty, &dirty[i], sizeof(groupDirty));
+		memcpy(&groupChildren, &isChild[i], sizeof(groupChildren));
+		if (!(groupDirty & ~groupChildren))
+			continue;
+
+		if (!groupChildren)
+		{
+			UpdateWorldMatrices4(i);
+			continue;
+		}
+
+		for (size_t lane = i; lane < i + 4; ++lane)
+		{
+			if (dirty[lane] && !isChild[lane])
+			{
+				UpdateWorldMatrix(lane);
+			}
+		}
+	}
+#endif
+	for (; i < end; ++i)
+	{
+		if (dirty[i] && !isChild[i])
+		{
+			UpdateWorldMatrix(i);
+		}
+	}
+
+	uint32_t recomputed = 0;
+	for (i = first; i < end; ++i)
+	{
+		if (dirty[i] && !isChild[i])
+		{
+			UpdateBounds(i);
+			dirty[i] = 0;
+			recomputed++;
+		}
+	}
+
+	if (recomputed)
+	{
+		recomputeCount.fetch_add(recomputed, memory_order_relaxed);
+	}
+}
+
+void TransformSystem::UpdateSubtrees(size_t firstSubtree, size_t subtreeCount)
+{
+	uint32_t recomputed = 0;
+	for (size_t i = subtreeStarts[firstSubtree]; i < subtreeStarts[firstSubtree + subtreeCount]; ++i)
+	{
+		uint32_t index = hierarchyOrder[i];
+		if (dirty[index])
+		{
+			UpdateChild(index);
+			recomputed++;
+		}
+	}
+
+	if (recomputed)
+	{
+		recomputeCount.fetch_add(recomputed, memory_order_relaxed);
+	}
+}
+
+void TransformSystem::UpdateAll()
+{
+	if (hierarchyChanged)
+	{
+		RebuildHierarchyOrder();
+	}
+	if (dirtyCount.load(memory_order_relaxed) == 0)
+		return;
+
+	PropagateDirty();
+	UpdateRange(0, count);
+	if (!subtreeStarts.empty())
+	{
+		UpdateSubtrees(0, GetSubtreeCount());
+	}
+	dirtyCount.store(0, memory_order_relaxed);
+}
+
+void TransformSystem::UpdateAll(ThreadPool& pool, size_t batchSize)
+{
+	// Keep batches a multiple of the SIMD width so only the last one has a scalar tail
+	batchSize = max((size_t)4, (batchSize + 3) & ~(size_t)3);
+	size_t batchCount = (count + batchSize - 1) / batchSize;
+	if (batchCount <= 1 || dirtyCount.load(memory_order_relaxed) == 0)
+	{
+		UpdateAll();
+		return;
+	}
+
+	while (jobs.size() < batchCount)
+	{
+		jobs.push_back(make_unique<TransformUpdateJob>());
+	}
+
+	jobPointers.clear();
+	for (size_t b = 0; b < batchCount; ++b)
+	{
+		auto job = jobs[b].get();
+		job->transforms = this;
+		job->first = b * batchSize;
+		job->count = min(batchSize, count - job->first);
+		jobPointers.push_back(job);
+	}
+
+	if (hierarchyChanged)
+	{
+		RebuildHierarchyOrder();
+	}
+	PropagateDirty();
+
+	pool.EnqueueBatch(jobPointers, &jobsCounter, JobPriority::Critical);
+	pool.WaitForCounter(&jobsCounter);
+
+	// Children only once every root is done, whole subtrees per job
+	jobPointers.clear();
+	size_t subtreeCount = GetSubtreeCount();
+	for (size_t first = 0; first < subtreeCount;)
+	{
+		size_t last = first + 1;
+		while (last < subtreeCount && subtreeStarts[last + 1] - subtreeStarts[first] <= batchSize)
+		{
+			last++;
+		}
+
+		if (hierarchyJobs.size() <= jobPointers.size())
+		{
+			hierarchyJobs.push_back(make_unique<TransformHierarchyJob>());
+		}
+		auto job = hierarchyJobs[jobPointers.size()].get();
+		job->transforms = this;
+		job->firstSubtree = first;
+		job->subtreeCount = last - first;
+		jobPointers.push_back(job);
+		first = last;
+	}
+
+	if (jobPointers.size() == 1)
+	{
+		UpdateSubtrees(0, subtreeCount);
+	}
+	else if (!jobPointers.empty())
+	{
+		pool.EnqueueBatch(jobPointers, &jobsCounter, JobPriority::Critical);
+		pool.WaitForCounter(&jobsCounter);
+	}
+	dirtyCount.store(0, memory_order_relaxed);
+}
+
+// World = Scale * Rotation * Translation in DirectXMath's row vector
+// convention, stored transposed. Row r of the stored matrix is column r of
+// the world matrix, so it is (R0[r] * sx, R1[r] * sy, R2[r] * sz, t[r]).
+void TransformSystem::UpdateWorldMatrices4(size_t first)
+{
+#if TRANSFORM_SYSTEM_SSE
+	__m128 qx = _mm_loadu_ps(&rotationX[first]);
+	__m128 qy = _mm_loadu_ps(&rotationY[first]);
+	__m128 qz = _mm_loadu_ps(&rotationZ[first]);
+	__m128 qw = _mm_loadu_ps(&rotationW[first]);
+	__m128 sx = _mm_loadu_ps(&scaleX[first]);
+	__m128 sy = _mm_loadu_ps(&scaleY[first]);
+	__m128 sz = _mm_loadu_ps(&scaleZ[first]);
+
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 x2 = _mm_mul_ps(qx, two);
+	__m128 y2 = _mm_mul_ps(qy, two);
+	__m128 z2 = _mm_mul_ps(qz, two);
+	__m128 xx = _mm_mul_ps(qx, x2);
+	__m128 yy = _mm_mul_ps(qy, y2);
+	__m128 zz = _mm_mul_ps(qz, z2);
+	__m128 xy = _mm_mul_ps(qx, y2);
+	__m128 xz = _mm_mul_ps(qx, z2);
+	__m128 yz = _mm_mul_ps(qy, z2);
+	__m128 wx = _mm_mul_ps(qw, x2);
+	__m128 wy = _mm_mul_ps(qw, y2);
+	__m128 wz = _mm_mul_ps(qw, z2);
+
+	// Rotation matrix rows, scaled
+	__m128 r00 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+	__m128 r01 = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+	__m128 r02 = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+	__m128 r10 = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+	__m128 r11 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+	__m128 r12 = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+	__m128 r20 = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+	__m128 r21 = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+	__m128 r22 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+
+	__m128 rows[3][4] = {
+		{ r00, r10, r20, _mm_loadu_ps(&positionX[first]) },
+		{ r01, r11, r21, _mm_loadu_ps(&positionY[first]) },
+		{ r02, r12, r22, _mm_loadu_ps(&positionZ[first]) },
+	};
+
+	// Each lane is one transform, transpose to get one matrix row per transform
+	for (int r = 0; r < 3; ++r)
+	{
+		__m128 a = rows[r][0], b = rows[r][1], c = rows[r][2], d = rows[r][3];
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+		_mm_storeu_ps(&worldMatrices[first + 0].m[r][0], a);
+		_mm_storeu_ps(&worldMatrices[first + 1].m[r][0], b);
+		_mm_storeu_ps(&worldMatrices[first + 2].m[r][0], c);
+		_mm_storeu_ps(&worldMatrices[first + 3].m[r][0], d);
+	}
+
+	__m128 lastRow = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	for (size_t i = 0; i < 4; ++i)
+	{
+		_mm_storeu_ps(&worldMatrices[first + i].m[3][0], lastRow);
+	}
+#endif
+}
+
+void TransformSystem::UpdateWorldMatrix(size_t index)
+{
+	XMVECTOR rotation = XMVectorSet(rotationX[index], rotationY[index], rotationZ[index], rotationW[index]);
+	XMMATRIX world = XMMatrixScaling(scaleX[index], scaleY[index], scaleZ[index]) *
+		XMMatrixRotationQuaternion(rotation) *
+		XMMatrixTranslation(positionX[index], positionY[index], positionZ[index]);
+	XMStoreFloat4x4(&worldMatrices[index], XMMatrixTranspose(world));
+}
+
+// World = Local * ParentWorld, the parent is already up to date
+void TransformSystem::UpdateChild(size_t index)
+{
+	XMVECTOR rotation = XMVectorSet(rotationX[index], rotationY[index], rotationZ[index], rotationW[index]);
+	XMMATRIX local = XMMatrixScaling(scaleX[index], scaleY[index], scaleZ[index]) *
+		XMMatrixRotationQuaternion(rotation) *
+		XMMatrixTranslation(positionX[index], positionY[index], positionZ[index]);
+	XMMATRIX parentWorld = XMMatrixTranspose(XMLoadFloat4x4(&worldMatrices[parents[index]]));
+	XMMATRIX world = local * parentWorld;
+	XMStoreFloat4x4(&worldMatrices[index], XMMatrixTranspose(world));
+
+	// Box transform takes per axis scale from the matrix rows, shear from
+	// non-uniformly scaled parents is not represented
+	localBounds[index].Transform(worldBounds[index], world);
+	XMFLOAT3 corners[BoundingOrientedBox::CORNER_COUNT];
+	worldBounds[index].GetCorners(corners);
+	BoundingBox::CreateFromPoints(worldAABBs[index], BoundingOrientedBox::CORNER_COUNT, corners, sizeof(XMFLOAT3));
+	dirty[index] = 0;
+}
+
+void TransformSystem::UpdateBounds(size_t index)
+{
+	XMVECTOR rotation = XMVectorSet(rotationX[index], rotationY[index], rotationZ[index], rotationW[index]);
+	XMVECTOR scale = XMVectorSet(scaleX[index], scaleY[index], scaleZ[index], 0.0f);
+	XMVECTOR position = XMVectorSet(positionX[index], positionY[index], positionZ[index], 0.0f);
+
+	// Scale the local box first, the box transform only handles uniform scale
+	const BoundingOrientedBox& local = localBounds[index];
+	BoundingOrientedBox& bounds = worldBounds[index];
+	XMVECTOR center = XMVectorAdd(XMVector3Rotate(XMVectorMultiply(XMLoadFloat3(&local.Center), scale), rotation), position);
+	XMStoreFloat3(&bounds.Center, center);
+	XMStoreFloat3(&bounds.Extents, XMVectorMultiply(XMLoadFloat3(&local.Extents), XMVectorAbs(scale)));
+	XMStoreFloat4(&bounds.Orientation, XMQuaternionMultiply(XMLoadFloat4(&local.Orientation), rotation));
+
+	XMFLOAT3 corners[BoundingOrientedBox::CORNER_COUNT];
+	bounds.GetCorners(corners);
+	BoundingBox::CreateFromPoints(worldAABBs[index], BoundingOrientedBox::CORNER_COUNT, corners, sizeof(XMFLOAT3));
+}
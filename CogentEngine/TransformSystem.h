@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+class TransformUpdateJob;
+class TransformHierarchyJob;
+
+static const uint32_t INVALID_TRANSFORM = UINT32_MAX;
+
+// Transforms of all entities as structure of arrays: every component of
+// position, rotation quaternion and scale lives in its own contiguous float
+// array. World matrices are rebuilt four transforms at a time with SSE, one
+// transform per SIMD lane. Entity only holds an index into here.
+//
+// Setters mark a transform dirty only when a value actually changes, and
+// updates skip clean transforms, so static entities cost nothing per frame.
+//
+// Transforms may have a parent, their position, rotation and scale are then
+// relative to it. Roots are updated with SIMD as above, children afterwards
+// from a flat array holding every root's descendants in depth first order,
+// so each parent is resolved before its children. Subtrees of different
+// roots don't share data and are updated in parallel. Dirtying a transform
+// dirties its whole subtree.
+//
+// Setters only flag the transform they are given, so jobs that each own
+// different transforms may call them at once. The flags reach descendants
+// in a main thread pass at the start of UpdateAll, and UpdateIfDirty checks
+// the ancestors itself. Everything else is main thread only.
+class TransformSystem
+{
+public:
+	TransformSystem();
+	~TransformSystem();
+
+	// Reuses destroyed slots first
+	uint32_t Create();
+	// Unlinks the transform from its parent, detaches its children as roots
+	// and frees the slot. The index must not be used afterwards.
+	void Destroy(uint32_t index);
+	// Slots in use or free, indices are below this
+	size_t GetCount() const { return count; }
+
+	XMFLOAT3 GetPosition(uint32_t index) const;
+	void SetPosition(uint32_t index, const XMFLOAT3& position);
+
+	// Euler angles in radians, kept next to the quaternion for gameplay code
+	XMFLOAT3 GetRotation(uint32_t index) const;
+	void SetRotation(uint32_t index, const XMFLOAT3& rotation);
+	XMFLOAT4 GetRotationQuaternion(uint32_t index) const;
+
+	XMFLOAT3 GetScale(uint32_t index) const;
+	void SetScale(uint32_t index, const XMFLOAT3& scale);
+
+	// Mesh space box the world bounds are built from
+	void SetLocalBounds(uint32_t index, const BoundingOrientedBox& bounds);
+
+	// Pass INVALID_TRANSFORM to detach. Fails if it would create a cycle.
+	bool SetParent(uint32_t index, uint32_t parent);
+	uint32_t GetParent(uint32_t index) const { return parents[index]; }
+
+	// Only the transform's own flag, a dirty ancestor is not reflected until UpdateAll
+	bool IsDirty(uint32_t index) const { return dirty[index] != 0; }
+	// Recomputes one transform now if it or an ancestor changed since the last update
+	void UpdateIfDirty(uint32_t index);
+
+	// Results of the last update. The matrix is transposed, ready for shaders.
+	const XMFLOAT4X4& GetWorldMatrix(uint32_t index) const { return worldMatrices[index]; }
+	const BoundingOrientedBox& GetWorldBounds(uint32_t index) const { return worldBounds[index]; }
+	const BoundingBox& GetWorldAABB(uint32_t index) const { return worldAABBs[index]; }
+
+	// Rebuilds world matrices and bounds of the dirty root transforms in
+	// [first, first + rangeCount). Ranges that don't overlap may be updated
+	// from different threads.
+	void UpdateRange(size_t first, size_t rangeCount);
+	// Propagates to the dirty descendants of [firstSubtree, firstSubtree + count)
+	// once their roots are up to date. Subtrees may be split between threads.
+	void UpdateSubtrees(size_t firstSubtree, size_t subtreeCount);
+	size_t GetSubtreeCount() const { return subtreeStarts.empty() ? 0 : subtreeStarts.size() - 1; }
+	void UpdateAll();
+	// Splits the update into jobs of batchSize transforms and joins
+	void UpdateAll(ThreadPool& pool, size_t batchSize);
+
+	// Latches the number of transforms recomputed since the last call
+	void BeginFrame() { lastFrameRecomputeCount = recomputeCount.exchange(0, memory_order_relaxed); }
+	uint32_t GetLastFrameRecomputeCount() const { return lastFrameRecomputeCount; }
+
+private:
+	void UpdateWorldMatrices4(size_t first);
+	void UpdateWorldMatrix(size_t index);
+	void UpdateBounds(size_t index);
+	void UpdateChild(size_t index);
+	void ResetSlot(uint32_t index);
+	void Unlink(uint32_t index);
+	void MarkDirty(uint32_t index);
+	void PropagateDirty();
+	void RebuildHierarchyOrder();
+
+	size_t count = 0;
+	// Destroyed slots, kept clean so updates skip them
+	vector<uint32_t> freeSlots;
+
+	// One byte per transform so a SIMD group's flags can be tested at once.
+	// dirtyCount is atomic as setters may run on several jobs.
+	vector<uint8_t> dirty;
+	atomic<size_t> dirtyCount{ 0 };
+	atomic<uint32_t> recomputeCount{ 0 };
+	uint32_t lastFrameRecomputeCount = 0;
+
+	vector<float> positionX, positionY, positionZ;
+	vector<float> rotationX, rotationY, rotationZ, rotationW;
+	vector<float> scaleX, scaleY, scaleZ;
+	vector<XMFLOAT3> eulerRotations;
+
+	// Intrusive child lists, isChild doubles as a SIMD group mask
+	vector<uint32_t> parents;
+	vector<uint32_t> firstChildren;
+	vector<uint32_t> nextSiblings;
+	vector<uint8_t> isChild;
+	// Descendants of every root with children, depth first, one range per root
+	vector<uint32_t> hierarchyOrder;
+	vector<uint32_t> subtreeStarts;
+	bool hierarchyChanged = false;
+
+	vector<XMFLOAT4X4> worldMatrices;
+	vector<BoundingOrientedBox> localBounds;
+	vector<BoundingOrientedBox> worldBounds;
+	vector<BoundingBox> worldAABBs;
+
+	vector<unique_ptr<TransformUpdateJob>> jobs;
+	vector<unique_ptr<TransformHierarchyJob>> hierarchyJobs;
+	vector<IJob*> jobPointers;
+	JobCounter jobsCounter;
+};